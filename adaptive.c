@@ -0,0 +1,95 @@
+#include <math.h>
+#include <stdbool.h>
+
+#include "adaptive.h"
+#include "bits.h"
+
+// Independent compensated sums, so the loop has no carried dependency chain
+// longer than one lane and the compiler can keep them in vector registers.
+#define LANES 4
+
+// Sums whose magnitude could overflow one of the error free products.
+#define ADAPTIVE_MAX 0x1p1000
+
+// Knuth's two-sum, s + t == a + b exactly.
+static inline double two_sum(double a, double b, double *t) {
+	double s = a + b, bb = s - a;
+
+	*t = (a - (s - bb)) + (b - bb);
+	return s;
+}
+
+// Smaller of the two gaps from |r| to its neighbours.
+static double ulp_below(double r) {
+	r = fabs(r);
+	return r > 0 ? r - nextafter(r, 0) : nextafter(0, 1);
+}
+
+// Try the compensated mean. The exact sum is s + c with an error of at most
+// err, the sum of the magnitudes of every rounded add to c times 2^-53, which
+// the 2^-52 factor covers along with the rounding of err itself for any
+// n < 2^53. The candidate r is accepted when the remaining error keeps
+// sum / n strictly inside r's rounding interval.
+bool try_compensated(const double *data, int n, double *avg) {
+	double s[LANES] = {0}, c[LANES] = {0}, e[LANES] = {0}, t;
+	double sum, comp, err, nd = n, r, p, pe, h, l, res, bound;
+	int i = 0;
+
+	for (; i + LANES <= n; i += LANES){
+		for (int k = 0; k < LANES; k++){
+			s[k] = two_sum(s[k], data[i + k], &t);
+			c[k] += t;
+			e[k] += fabs(c[k]);
+		}
+	}
+	for (; i < n; i++){
+		s[0] = two_sum(s[0], data[i], &t);
+		c[0] += t;
+		e[0] += fabs(c[0]);
+	}
+
+	sum = s[0];
+	comp = c[0];
+	err = e[0];
+	for (int k = 1; k < LANES; k++){
+		sum = two_sum(sum, s[k], &t);
+		comp += t;
+		err += e[k] + fabs(comp);
+		comp += c[k];
+		err += fabs(comp);
+	}
+	sum = two_sum(sum, comp, &comp);
+	err *= 0x1p-52;
+
+	if (!isfinite(sum) || !isfinite(err) || fabs(sum) > ADAPTIVE_MAX) {
+		return false;
+	}
+
+	// Residual sum - r * n, with r * n split exactly into p + pe. The first
+	// guess only saw sum, one correction step by res / n folds in comp and
+	// the rounding of the division.
+	r = sum / nd;
+	for (int step = 0; step < 2; step++){
+		p = r * nd;
+		pe = fma(r, nd, -p);
+		h = two_sum(sum, -p, &l);
+		res = h + (l + (comp - pe));
+
+		bound = err + 0x1p-50 * (fabs(h) + fabs(l) + fabs(comp) + fabs(pe));
+		if (fabs(res) + bound < 0.5 * ulp_below(r) * nd * (1 - 0x1p-40)) {
+			*avg = r;
+			return true;
+		}
+		r += res / nd;
+	}
+	return false;
+}
+
+double avg_adaptive(const double *data, int n) {
+	double avg;
+
+	if (n > 0 && try_compensated(data, n, &avg)) {
+		return avg;
+	}
+	return avg_bits(data, n);
+}
@@ -0,0 +1,15 @@
+#ifndef DOUBLES_ADAPTIVE_H
+#define DOUBLES_ADAPTIVE_H
+
+#include <stdbool.h>
+
+// Tiered averaging. A compensated sum with a running error bound is tried
+// first, and its mean is returned when the bound proves it is the correctly
+// rounded one. Otherwise the exact cells decide, as avg_bits would.
+double avg_adaptive(const double *data, int n);
+
+// The compensated tier alone, for n > 0. Returns true with the correctly
+// rounded mean in avg when the error bound proves it, false otherwise.
+bool try_compensated(const double *data, int n, double *avg);
+
+#endif //DOUBLES_ADAPTIVE_H
@@ -0,0 +1,32 @@
+#include <string.h>
+
+#include "adaptive.h"
+#include "batch.h"
+#include "bits.h"
+
+void avg_segments(const double *data, const int64_t *offsets, int num, double *out) {
+	int64_t sums[NUM_SIZES];
+	int lo, hi, n;
+
+	memset(sums, 0, sizeof(sums));
+
+	for (int s = 0; s < num; s++){
+		n = (int) (offsets[s + 1] - offsets[s]);
+		if (n == 0) {
+			out[s] = 0.0;
+			continue;
+		}
+		if (try_compensated(data + offsets[s], n, &out[s])) {
+			continue;
+		}
+
+		lo = NUM_SIZES;
+		hi = 0;
+		compute_sums(data + offsets[s], sums, n, &lo, &hi);
+		carry_cells(sums, lo, &hi);
+		normalize_cells(sums, &lo, &hi);
+		out[s] = compute_avg(sums, n, lo, hi, ROUND_NEAREST);
+
+		memset(sums + lo, 0, (hi - lo + 1) * sizeof(int64_t));
+	}
+}
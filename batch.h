@@ -0,0 +1,15 @@
+#ifndef DOUBLES_BATCH_H
+#define DOUBLES_BATCH_H
+
+#include <stdint.h>
+
+// Exact means of many short series in one call. Segment s is data[offsets[s]]
+// up to but not including data[offsets[s + 1]], so offsets holds num + 1
+// non decreasing positions, and its mean goes to out[s], 0 for an empty
+// segment. Each segment first tries the compensated tier of avg_adaptive.
+// The rest share one scratch set of cells, zeroed once per call, and only
+// the window a segment touched is cleared after it, so a short segment never
+// pays for all NUM_SIZES cells.
+void avg_segments(const double *data, const int64_t *offsets, int num, double *out);
+
+#endif //DOUBLES_BATCH_H
@@ -0,0 +1,230 @@
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+#include "engines.h"
+#include "narrow.h"
+#include "trace.h"
+
+#define BENCH_HEADER "%-26s %-11s %-8s %10s %12s %12s %12s %12s %10s %12s\n"
+#define BENCH_ROW "%-26s %-11s %-8s %10d %12.3lf %12.1lf %12.1lf %12.1lf %10.2lf %12.5lg\n"
+
+struct BenchResult {
+	const char *trace;
+	const char *engine;
+	const char *ordering;
+	int n;
+	int reps;
+	double min, median, p99;
+	double avg, err;
+};
+
+static int64_t now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cmp_time(const void *ap, const void *bp) {
+	double a = *(double *)ap;
+	double b = *(double *)bp;
+	return (a > b) - (a < b);
+}
+
+// One timed call, a double engine when func is set and otherwise the narrow
+// kernel of format on values already converted to it.
+struct BenchCall {
+	avg_func func;
+	int format;
+	const void *data;
+	int n;
+};
+
+static double bench_call(const struct BenchCall *call) {
+	if (call->func) {
+		return call->func(call->data, call->n);
+	}
+	return (double) narrow_avg(call->format, call->data, call->n);
+}
+
+// Run the call reps times and fill in the timing statistics, in ns.
+static void time_engine(const struct BenchCall *call, int reps, double *times, struct BenchResult *res) {
+	int64_t start;
+
+	res->avg = bench_call(call);
+	for (int r = 0; r < reps; r++){
+		start = now_ns();
+		res->avg = bench_call(call);
+		times[r] = (double) (now_ns() - start);
+	}
+
+	qsort(times, reps, sizeof(double), cmp_time);
+	res->min = times[0];
+	res->median = reps % 2 ? times[reps / 2] : (times[reps / 2 - 1] + times[reps / 2]) / 2;
+	res->p99 = times[(99 * reps + 99) / 100 - 1];
+}
+
+// JSON has no inf or nan, those come out as null.
+static void print_json_number(const char *key, double x) {
+	if (isfinite(x)) {
+		printf(", \"%s\": %.17lg", key, x);
+	} else {
+		printf(", \"%s\": null", key);
+	}
+}
+
+static void print_result(const struct BenchResult *res, int format, bool first) {
+	double ns_elem = res->median / res->n;
+	double melems = res->n / res->median * 1e3;
+
+	switch (format) {
+	case BENCH_CSV:
+		printf("%s,%s,%s,%d,%d,%.3lf,%.2lf,%.0lf,%.0lf,%.0lf,%.17lg,%.17lg\n",
+			res->trace, res->engine, res->ordering, res->n, res->reps, ns_elem, melems,
+			res->min, res->median, res->p99, res->avg, res->err);
+		break;
+	case BENCH_JSON:
+		printf("%s\n  {\"trace\": \"%s\", \"engine\": \"%s\", \"ordering\": \"%s\", \"n\": %d, \"reps\": %d, "
+			"\"ns_per_element\": %.3lf, \"melem_per_s\": %.2lf, \"min_ns\": %.0lf, \"median_ns\": %.0lf, "
+			"\"p99_ns\": %.0lf",
+			first ? "" : ",", res->trace, res->engine, res->ordering, res->n, res->reps, ns_elem, melems,
+			res->min, res->median, res->p99);
+		print_json_number("avg", res->avg);
+		print_json_number("rel_error", res->err);
+		printf("}");
+		break;
+	default:
+		printf(BENCH_ROW, res->trace, res->engine, res->ordering, res->n, ns_elem, res->min / 1e3,
+			res->median / 1e3, res->p99 / 1e3, melems, res->err);
+	}
+}
+
+int bench_dir(const char *dir, int reps, int format) {
+	struct Trace trace;
+	struct BenchResult res;
+	struct BenchCall call;
+	char **names;
+	char path[2048];
+	double *data, *sorted, *times, ref;
+	void *narrow;
+	int n, err, num_traces, failed = 0;
+	bool first = true;
+
+	if ((num_traces = trace_list(dir, &names)) < 0) {
+		fprintf(stderr, "Directory path not found: %s\n", dir);
+		return 1;
+	}
+	reps = reps < 1 ? 1 : reps;
+	times = malloc(reps * sizeof(double));
+
+	switch (format) {
+	case BENCH_CSV:
+		printf("trace,engine,ordering,n,reps,ns_per_element,melem_per_s,min_ns,median_ns,p99_ns,avg,rel_error\n");
+		break;
+	case BENCH_JSON:
+		printf("[");
+		break;
+	default:
+		printf(BENCH_HEADER, "Trace", "Engine", "Order", "Length", "ns/elem", "Min(us)", "Median(us)", "P99(us)",
+			"Melem/s", "Error");
+	}
+
+	for (int f = 0; f < num_traces; f++){
+		snprintf(path, sizeof(path), "%s/%s", dir, names[f]);
+		if ((err = trace_open(&trace, path)) != 0) {
+			fprintf(stderr, "cannot open file '%s': %s\n", names[f], strerror(err));
+			failed = 1;
+			break;
+		}
+		if (trace.n > INT_MAX) {
+			fprintf(stderr, "cannot read file '%s': %s\n", names[f], strerror(EFBIG));
+			trace_close(&trace);
+			failed = 1;
+			break;
+		}
+
+		data = malloc(trace.n * sizeof(double));
+		sorted = malloc(trace.n * sizeof(double));
+		narrow = malloc(trace.n * sizeof(long double));
+		n = trace_read(&trace, data, (int) trace.n);
+		trace_close(&trace);
+		if (trace.err) {
+			fprintf(stderr, "cannot read file '%s': %s\n", names[f], strerror(trace.err));
+			failed = 1;
+		}
+		if (trace.err || n == 0) {
+			free(data);
+			free(sorted);
+			free(narrow);
+			if (failed) {
+				break;
+			}
+			continue;
+		}
+
+		for (int o = 0; o < num_orderings; o++){
+			memcpy(sorted, data, n * sizeof(double));
+			if (orderings[o].func) {
+				qsort(sorted, n, sizeof(double), orderings[o].func);
+			}
+
+			res.trace = names[f];
+			res.ordering = orderings[o].name;
+			res.n = n;
+			res.reps = reps;
+			call.data = sorted;
+			call.n = n;
+
+			for (int e = 0; e < num_engines; e++){
+				res.engine = engines[e].name;
+				call.func = engines[e].func;
+				time_engine(&call, reps, times, &res);
+				res.err = trace.avg != 0 ? (trace.avg - res.avg) / trace.avg : res.avg;
+
+				print_result(&res, format, first);
+				first = false;
+			}
+
+			// The narrow kernels on the same values rounded into their
+			// formats, against the exact mean of the rounded values.
+			for (int k = 0; k < num_narrow; k++){
+				if (!narrow_convert(narrow_formats[k].format, sorted, narrow, n)) {
+					continue;
+				}
+				res.engine = narrow_formats[k].name;
+				call.func = NULL;
+				call.format = narrow_formats[k].format;
+				call.data = narrow;
+				time_engine(&call, reps, times, &res);
+				ref = (double) narrow_reference(call.format, narrow, n);
+				res.err = ref != 0 ? (ref - res.avg) / ref : res.avg;
+
+				print_result(&res, format, first);
+				first = false;
+			}
+		}
+
+		free(data);
+		free(sorted);
+		free(narrow);
+	}
+
+	if (format == BENCH_JSON) {
+		printf("\n]\n");
+	}
+
+	for (int f = 0; f < num_traces; f++){
+		free(names[f]);
+	}
+	free(names);
+	free(times);
+	return failed;
+}
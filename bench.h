@@ -0,0 +1,18 @@
+#ifndef DOUBLES_BENCH_H
+#define DOUBLES_BENCH_H
+
+// Output formats of the benchmark report.
+enum {
+	BENCH_TABLE,
+	BENCH_CSV,
+	BENCH_JSON
+};
+
+// Time every registered engine under every ordering on each trace in dir, and
+// the narrow kernels on the values rounded into their formats where they fit.
+// Loading and sorting stay outside the timed region, each combination gets one
+// warm up run followed by reps timed runs. Returns 0, or 1 if a trace cannot
+// be read.
+int bench_dir(const char *dir, int reps, int format);
+
+#endif //DOUBLES_BENCH_H
@@ -0,0 +1,692 @@
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bits.h"
+
+#ifdef BITS_STATS
+_Thread_local struct BitsStats bits_stats;
+
+void bits_stats_reset(void) {
+	memset(&bits_stats, 0, sizeof(bits_stats));
+}
+#endif
+
+// Add x to the appropriate index (in either sums or avgs). In the case that
+// this would overflow what would be the fractional field, add to the next class
+// up. Returns the highest index the add reached. The array holds size cells.
+int64_t recursive_add_sized(int64_t *cells, int size, int64_t ind, int64_t x) {
+    if (ind >= size) {
+        raise(SIGINT);
+    }
+    int64_t a = cells[ind];
+    int64_t top = ind;
+
+    // If adding x to the current index would overflow,
+    // recurse and add to the next size up. Same the remainder for current size.
+
+    // `a + x` would overflow or underflow
+    if (((x > 0) && (a > INT52_MAX - x))
+    ||  ((x < 0) && (a < INT52_MIN - x))) {
+	    top = recursive_add_sized(cells, size, ind + 1, cells[ind] / 16);
+	    cells[ind] = cells[ind] % 16;
+	    STATS_ADD(carries, 1);
+    }
+
+	cells[ind] += x;
+	STATS_ADD(adds, 1);
+	STATS_MAX(max_depth, (int) (top - ind + 1));
+	return top;
+}
+
+// recursive_add_sized on the NUM_SIZES cells of a double accumulator.
+int64_t recursive_add(int64_t *cells, int64_t ind, int64_t x) {
+	return recursive_add_sized(cells, NUM_SIZES, ind, x);
+}
+
+// Rewrite the cells in the window [lo, hi] so that every cell holds a single
+// nibble carrying the sign of the whole sum, apart from the top cell which
+// takes whatever is left. Different carry histories of the same sum end up as
+// identical cells, so compute_avg gives the same answer however the data was
+// chunked or split between threads. Cells above hi are taken as zero, whatever
+// they hold, and written once the carry reaches them.
+void normalize_cells(int64_t *cells, int *lo, int *hi) {
+	int64_t x, carry = 0, sign = 1;
+	int i;
+
+	STATS_ADD(sweeps, 2);
+
+	// Borrow everything below the window's top cell into it, which leaves the
+	// top cell with the sign of the sum.
+	for (i = *lo; i < *hi; i++){
+		x = cells[i] + carry;
+		cells[i] = x & 0xF;
+		carry = x >> 4;
+	}
+	cells[*hi] += carry;
+
+	if (cells[*hi] < 0) {
+		sign = -1;
+	}
+
+	// Carry the magnitude up until it runs out, then flip the sign back.
+	carry = 0;
+	for (i = *lo; i < NUM_SIZES - 1 && (i <= *hi || carry != 0); i++){
+		x = sign * (i <= *hi ? cells[i] : 0) + carry;
+		cells[i] = sign * (x & 0xF);
+		carry = x >> 4;
+	}
+	cells[i] = (i <= *hi ? cells[i] : 0) + sign * carry;
+
+	*hi = i;
+	while (*hi > *lo && cells[*hi] == 0) {
+		(*hi)--;
+	}
+}
+
+// Add every cell of src's window into dst, carrying exactly like the per
+// element adds, and widen dst's window to cover the result.
+void merge_cells(int64_t *dst, int *dst_lo, int *dst_hi, const int64_t *src, int src_lo, int src_hi) {
+	int64_t top;
+
+	for (int i = src_lo; i <= src_hi; i++){
+		if (src[i] != 0) {
+			top = recursive_add(dst, i, src[i]);
+			if (top > *dst_hi) {
+				*dst_hi = (int) top;
+			}
+		}
+	}
+	if (src_lo < *dst_lo) {
+		*dst_lo = src_lo;
+	}
+	if (src_hi > *dst_hi) {
+		*dst_hi = src_hi;
+	}
+}
+
+// Split all numbers across several split sums. lo and hi are widened to the
+// lowest and highest cell touched.
+void compute_sums_scalar(const double *data, int64_t *sums, int n, int *lo, int *hi) {
+	int64_t exp, shift, ind, frac, top;
+	int low = *lo, high = *hi;
+	bool sign;
+
+	union Data64 val;
+
+	for (int i = 0; i < n; i++){
+		val.f = data[i];
+
+		// Extract fraction, exponent and sign data from the bit vector.
+		sign = (val.u & SIGN) >> 52;
+		exp = (val.u & EXP) >> 52;
+		frac = (val.u & FRAC);
+
+		// Add implied leading one for normalized fractions.
+		if (exp) {
+			frac = frac | ONE;
+		}
+
+		// Subnormals share the scale of the smallest normal exponent.
+		exp += !exp;
+
+		// Shift the fraction by the first 2 bits of the exponent field.
+		// Use remaining 9 bits for the index into sums.
+		shift = exp & SHIFT;
+		ind = (exp & IND) >> 2;
+		frac <<= shift;
+
+		if (ind < low) {
+			low = (int) ind;
+		}
+
+		// the 13 least significant nibbles (half bytes) are where the fraction bytes will be.
+		// Add each nibble's value to the appropriate cell.
+		int64_t nib = 0xF;
+		int64_t x;
+		for (int j = 0; j <= 13; j++){
+			x = ((frac & nib) >> (j * 4));
+			x *= (sign ? -1 : 1);
+
+			top = recursive_add(sums, ind + j, x);
+			if (top > high) {
+				high = (int) top;
+			}
+
+			nib <<= 4;
+		}
+	}
+	*lo = low;
+	*hi = high;
+}
+
+// Add sign * p units of cell ind to the cells, 32 bits at a time. Whatever is
+// left once the pieces reach the top cell goes in as a multiple of it. Returns
+// the highest cell touched.
+int64_t add_product(int64_t *cells, int64_t ind, unsigned __int128 p, int64_t sign) {
+	int64_t top, high = ind, shift;
+
+	for (; p; p >>= 32, ind += 8){
+		if (ind >= NUM_SIZES - 1) {
+			shift = 4 * (ind - (NUM_SIZES - 1));
+			if (p > (unsigned __int128) (INT52_MAX >> shift)) {
+				raise(SIGINT);
+			}
+			top = recursive_add(cells, NUM_SIZES - 1, sign * (int64_t) (p << shift));
+			return top > high ? top : high;
+		}
+		top = recursive_add(cells, ind, sign * (int64_t) (p & 0xFFFFFFFF));
+		high = top > high ? top : high;
+	}
+	return high;
+}
+
+// Weighted compute_sums, element i counts mult[i] times. The shifted fraction
+// is multiplied by its count in 128 bits and added in 32 bit pieces, so the
+// cost does not depend on the size of the count.
+void compute_sums_weighted(const double *data, const int64_t *mult, int64_t *sums, int n, int *lo, int *hi) {
+	int64_t exp, ind, frac, top;
+	int low = *lo, high = *hi;
+
+	union Data64 val;
+
+	for (int i = 0; i < n; i++){
+		if (mult[i] == 0) {
+			continue;
+		}
+		val.f = data[i];
+
+		exp = (val.u & EXP) >> 52;
+		frac = (val.u & FRAC);
+		if (exp) {
+			frac = frac | ONE;
+		}
+		exp += !exp;
+		ind = (exp & IND) >> 2;
+		frac <<= exp & SHIFT;
+
+		if (ind < low) {
+			low = (int) ind;
+		}
+
+		top = add_product(sums, ind, (unsigned __int128) frac * (uint64_t) mult[i], val.i < 0 ? -1 : 1);
+		if (top > high) {
+			high = (int) top;
+		}
+	}
+	*lo = low;
+	*hi = high;
+}
+
+// Carry-save version of compute_sums. The nibbles go in without any overflow
+// check or branch, the cells' headroom above INT52 absorbs them until the next
+// carry_cells.
+void compute_sums_deferred_scalar(const double *data, int64_t *sums, int n, int *lo, int *hi) {
+	union Data64 val;
+	int64_t exp, frac, sign, ind;
+	int low = *lo, high = *hi;
+
+	for (int i = 0; i < n; i++){
+		val.f = data[i];
+
+		sign = val.i >> 63;
+		exp = (val.u & EXP) >> 52;
+		frac = val.u & FRAC;
+
+		if (exp) {
+			frac = frac | ONE;
+		}
+		exp += !exp;
+		frac <<= exp & SHIFT;
+		ind = (exp & IND) >> 2;
+
+		low = ind < low ? (int) ind : low;
+		high = ind + 13 > high ? (int) ind + 13 : high;
+
+		for (int j = 0; j <= 13; j++){
+			sums[ind + j] += (((frac >> (j * 4)) & 0xF) ^ sign) - sign;
+		}
+	}
+	*lo = low;
+	*hi = high;
+}
+
+// Bring every cell in the window back inside the INT52 bounds, carrying the
+// excess up the same way recursive_add does when a single add overflows. A
+// carry past hi clears the cell it lands in first.
+void carry_cells(int64_t *cells, int lo, int *hi) {
+	STATS_ADD(sweeps, 1);
+	for (int i = lo; i <= *hi && i < NUM_SIZES - 1; i++){
+		if (cells[i] > INT52_MAX || cells[i] < INT52_MIN) {
+			if (i + 1 > *hi) {
+				cells[i + 1] = 0;
+				*hi = i + 1;
+			}
+			cells[i + 1] += cells[i] / 16;
+			cells[i] = cells[i] % 16;
+		}
+	}
+}
+
+// Which compute_sums kernel to run, KERNEL_AUTO picks the widest one the CPU
+// supports.
+int bits_kernel = KERNEL_AUTO;
+
+void compute_sums(const double *data, int64_t *sums, int n, int *lo, int *hi) {
+	sums_kernel kernel = bits_kernel == KERNEL_SCALAR ? NULL : simd_kernel(bits_kernel, false);
+
+	if (!kernel) {
+		kernel = compute_sums_scalar;
+	}
+	kernel(data, sums, n, lo, hi);
+}
+
+void compute_sums_deferred(const double *data, int64_t *sums, int n, int *lo, int *hi) {
+	sums_kernel kernel = bits_kernel == KERNEL_SCALAR ? NULL : simd_kernel(bits_kernel, true);
+
+	if (!kernel) {
+		kernel = compute_sums_deferred_scalar;
+	}
+	kernel(data, sums, n, lo, hi);
+}
+
+// Set up the reciprocal for d, following libdivide's branchfree unsigned 64 bit
+// scheme. Powers of two are a plain shift. d must be below 2^63, which any
+// positive int64_t count is.
+void make_divider(struct Divider *div, uint64_t d) {
+	int log = 63 - __builtin_clzll(d);
+	unsigned __int128 m;
+
+	div->d = d;
+	div->shift = log;
+	div->magic = 0;
+
+	if (d & (d - 1)) {
+		// 2^(65 + log) / d rounded up, less the implicit 2^64 bit.
+		m = ((unsigned __int128) 1 << (65 + log)) / d;
+		div->magic = (uint64_t) m + 1;
+	}
+}
+
+// Pack normalized cells (every cell carrying the sign of the sum, see
+// normalize_cells) into a sign-magnitude big integer of 32 bit digits.
+void cells_to_fix(const int64_t *cells, int lo, int hi, struct BigFix *fix) {
+	int64_t sign = cells[hi] < 0 ? -1 : 1;
+	unsigned __int128 x;
+	int k;
+
+	memset(fix->d, 0, sizeof(fix->d));
+	fix->neg = sign < 0;
+
+	for (int i = lo; i <= hi; i++){
+		x = (unsigned __int128) (uint64_t) (cells[i] * sign) << ((4 * i) & 31);
+		for (k = (4 * i) >> 5; x; k++){
+			x += fix->d[k];
+			fix->d[k] = (uint32_t) x;
+			x >>= 32;
+		}
+	}
+
+	fix->len = NUM_DIGITS;
+	while (fix->len > 0 && fix->d[fix->len - 1] == 0) {
+		fix->len--;
+	}
+}
+
+// Magnitude d[0..len) divided by n and rounded in the given mode to prec
+// significant bits, returned as m with the position of its last bit in *lsb.
+// The quotient is m * 2^*lsb units of the dividend, where *lsb >= 1 because
+// the smallest subnormal of every format is two units.
+//
+// The magnitude is long divided by n from the top digit down through the
+// precomputed reciprocal. Two quotient digits below the leading one already
+// hold more than the 64 bits, round bit and sticky bit the widest format
+// needs, so the division stops there and the rest of the dividend only
+// decides whether the result was inexact.
+unsigned __int128 round_quotient(const uint32_t *d, int len, bool neg, int64_t n, int mode, int prec, int *lsb) {
+	uint32_t q[3] = {0}, qk;
+	uint64_t r = 0, t;
+	int k, top = -1, base, b;
+	bool round, sticky;
+	unsigned __int128 w, m;
+	struct Divider div;
+
+	make_divider(&div, n);
+
+	for (k = len - 1; k >= 0; k--){
+		STATS_ADD(div_steps, 1);
+		if (r >> 32) {
+			w = ((unsigned __int128) r << 32) | d[k];
+			qk = (uint32_t) (w / n);
+			r = (uint64_t) (w - (unsigned __int128) qk * n);
+		} else {
+			t = (r << 32) | d[k];
+			qk = (uint32_t) divide(t, &div);
+			r = t - (uint64_t) qk * (uint64_t) n;
+		}
+
+		if (top < 0 && qk) {
+			top = k;
+		}
+		if (top >= 0) {
+			q[top - k] = qk;
+			if (top - k == 2) {
+				break;
+			}
+		}
+	}
+
+	// Anything not divided out is below the round bit.
+	sticky = r != 0;
+	for (int j = 0; j < k; j++){
+		sticky |= d[j] != 0;
+	}
+
+	if (top < 0) {
+		// Below the smallest subnormal.
+		round = false;
+		m = 0;
+		*lsb = 1;
+	} else {
+		// Window of the leading three quotient digits, base is its bit offset.
+		base = top >= 2 ? 32 * (top - 2) : 0;
+		w = 0;
+		for (int j = 0; j <= 2 && top - j >= 0; j++){
+			w = (w << 32) | q[j];
+		}
+
+		// Highest set bit, in units of the dividend. Keep prec bits from
+		// there, or stop at the smallest subnormal.
+		b = 32 * top + 31 - __builtin_clz(q[0]);
+		*lsb = b - (prec - 1) > 1 ? b - (prec - 1) : 1;
+
+		m = w >> (*lsb - base);
+		round = (w >> (*lsb - 1 - base)) & 1;
+		sticky |= (w & (((unsigned __int128) 1 << (*lsb - 1 - base)) - 1)) != 0;
+	}
+
+	switch (mode) {
+	case ROUND_NEAREST:
+		m += round && (sticky || (m & 1));
+		break;
+	case ROUND_UP:
+		m += !neg && (round || sticky);
+		break;
+	case ROUND_DOWN:
+		m += neg && (round || sticky);
+		break;
+	default:
+		break;
+	}
+	return m;
+}
+
+// Exact mean sum / n rounded to a double in the given mode.
+double round_mean(const struct BigFix *sum, int64_t n, int mode) {
+	int lsb;
+	unsigned __int128 m = round_quotient(sum->d, sum->len, sum->neg, n, mode, 53, &lsb);
+
+	return ldexp((double) m, lsb - 1075) * (sum->neg ? -1 : 1);
+}
+
+// Turn normalized sums into the mean, rounded in the given mode. Only the cells
+// in the window [lo, hi] may be non zero.
+double compute_avg(const int64_t *sums, int64_t n, int lo, int hi, int mode){
+	struct BigFix sum;
+
+	cells_to_fix(sums, lo, hi, &sum);
+	return round_mean(&sum, n, mode);
+}
+
+// Copy the window [lo, hi] of src into dst. The rest of dst is left as it is,
+// the carry passes take the cells above hi as zero and clear them as they go.
+static void copy_window(int64_t *dst, const int64_t *src, int lo, int hi) {
+	if (lo <= hi) {
+		memcpy(dst + lo, src + lo, (hi - lo + 1) * sizeof(int64_t));
+	}
+}
+
+// Start the accumulator on an empty series, from memory in any state.
+void bits_init(struct BitsAcc *acc) {
+	memset(acc->sums, 0, sizeof(acc->sums));
+	acc->n = 0;
+	acc->deferred = false;
+	acc->pending = 0;
+	acc->lo = NUM_SIZES;
+	acc->hi = 0;
+}
+
+// Empty an accumulator bits_init has set up. Only its window can be non zero,
+// so that is all that gets cleared.
+void bits_reset(struct BitsAcc *acc) {
+	if (acc->lo <= acc->hi) {
+		memset(acc->sums + acc->lo, 0, (acc->hi - acc->lo + 1) * sizeof(int64_t));
+	}
+	acc->n = 0;
+	acc->deferred = false;
+	acc->pending = 0;
+	acc->lo = NUM_SIZES;
+	acc->hi = 0;
+}
+
+// Add the next n elements of the series to the accumulator.
+void bits_add_chunk(struct BitsAcc *acc, const double *data, int n) {
+	STATS_TIME(start);
+	int len;
+
+	acc->n += n;
+	if (!acc->deferred) {
+		compute_sums(data, acc->sums, n, &acc->lo, &acc->hi);
+		STATS_ADD(sums_ns, stats_now() - start);
+		return;
+	}
+
+	while (n > 0) {
+		if (acc->pending >= DEFER_NORM) {
+			carry_cells(acc->sums, acc->lo, &acc->hi);
+			acc->pending = 0;
+		}
+		len = DEFER_NORM - acc->pending < n ? (int) (DEFER_NORM - acc->pending) : n;
+
+		compute_sums_deferred(data, acc->sums, len, &acc->lo, &acc->hi);
+		acc->pending += len;
+		data += len;
+		n -= len;
+	}
+	STATS_ADD(sums_ns, stats_now() - start);
+}
+
+// Add n elements where element i occurs mult[i] times, mult[i] >= 0. The count
+// grows by the sum of mult, the cells by each value times its count.
+void bits_add_weighted(struct BitsAcc *acc, const double *data, const int64_t *mult, int n) {
+	for (int i = 0; i < n; i++){
+		acc->n += mult[i];
+	}
+	compute_sums_weighted(data, mult, acc->sums, n, &acc->lo, &acc->hi);
+}
+
+// Exact average of everything added so far, rounded in the given mode. The
+// cells are normalized on a copy, so the accumulator can keep taking chunks.
+double bits_finalize_rounded(const struct BitsAcc *acc, int mode) {
+	STATS_TIME(start);
+	int64_t sums[NUM_SIZES];
+	int lo = acc->lo, hi = acc->hi;
+	double avg;
+
+	if (acc->n == 0) {
+		return 0.0;
+	}
+
+	copy_window(sums, acc->sums, lo, hi);
+	carry_cells(sums, lo, &hi);
+	normalize_cells(sums, &lo, &hi);
+
+	avg = compute_avg(sums, acc->n, lo, hi, mode);
+	STATS_SET(lo, acc->lo);
+	STATS_SET(hi, acc->hi);
+	STATS_ADD(avg_ns, stats_now() - start);
+	return avg;
+}
+
+// Exact average of everything added so far, rounded to nearest even.
+double bits_finalize(const struct BitsAcc *acc) {
+	return bits_finalize_rounded(acc, ROUND_NEAREST);
+}
+
+// The exact sum of everything added so far, in units of 2^-1075.
+void bits_sum_fix(const struct BitsAcc *acc, struct BigFix *fix) {
+	int64_t sums[NUM_SIZES];
+	int lo = acc->lo, hi = acc->hi;
+
+	if (lo > hi) {
+		memset(fix, 0, sizeof(*fix));
+		return;
+	}
+
+	copy_window(sums, acc->sums, lo, hi);
+	carry_cells(sums, lo, &hi);
+	normalize_cells(sums, &lo, &hi);
+	cells_to_fix(sums, lo, hi, fix);
+}
+
+// Fold everything src has seen into dst.
+void bits_merge(struct BitsAcc *dst, const struct BitsAcc *src) {
+	int64_t sums[NUM_SIZES];
+	int hi = src->hi;
+
+	if (src->n == 0) {
+		return;
+	}
+
+	copy_window(sums, src->sums, src->lo, src->hi);
+	carry_cells(sums, src->lo, &hi);
+
+	merge_cells(dst->sums, &dst->lo, &dst->hi, sums, src->lo, hi);
+	dst->n += src->n;
+}
+
+// Scratch accumulator, one per thread. It is empty between calls, so a call
+// only clears the cells its data touched.
+static _Thread_local struct BitsAcc scratch = {.lo = NUM_SIZES};
+
+// By keeping track of multiple sums at different exponent levels, there is less
+// compute error, if not completely eliminated.
+double avg_bits(const double *data, int n){
+	double avg;
+
+	bits_add_chunk(&scratch, data, n);
+	avg = bits_finalize(&scratch);
+	bits_reset(&scratch);
+	return avg;
+}
+
+// avg_bits in carry-save mode.
+double avg_bits_deferred(const double *data, int n){
+	double avg;
+
+	scratch.deferred = true;
+	bits_add_chunk(&scratch, data, n);
+	avg = bits_finalize(&scratch);
+	bits_reset(&scratch);
+	return avg;
+}
+
+// avg_bits through one fixed compute_sums kernel, so the harness and --bench
+// can compare them side by side. A kernel the CPU lacks gives NAN rather than
+// quietly timing another one.
+static double avg_bits_kernel(const double *data, int n, int kernel) {
+	sums_kernel sums = kernel == KERNEL_SCALAR ? compute_sums_scalar : simd_kernel(kernel, false);
+	double avg;
+
+	if (!sums) {
+		return NAN;
+	}
+	scratch.n = n;
+	sums(data, scratch.sums, n, &scratch.lo, &scratch.hi);
+	avg = bits_finalize(&scratch);
+	bits_reset(&scratch);
+	return avg;
+}
+
+double avg_bits_scalar(const double *data, int n){
+	return avg_bits_kernel(data, n, KERNEL_SCALAR);
+}
+
+double avg_bits_avx2(const double *data, int n){
+	return avg_bits_kernel(data, n, KERNEL_AVX2);
+}
+
+double avg_bits_avx512(const double *data, int n){
+	return avg_bits_kernel(data, n, KERNEL_AVX512);
+}
+
+// Number of threads avg_bits_parallel splits its input across. Zero uses one
+// thread per online core.
+int bits_threads = 0;
+
+struct BitsTask {
+	const double *data;
+	int n;
+	struct BitsAcc acc;
+};
+
+static void *bits_worker(void *arg) {
+	struct BitsTask *task = arg;
+
+	bits_init(&task->acc);
+	bits_add_chunk(&task->acc, task->data, task->n);
+	return NULL;
+}
+
+// Same result as avg_bits, bit for bit. Every thread sums its own slice into a
+// private accumulator and the cells are merged before the single compute_avg.
+double avg_bits_parallel(const double *data, int n){
+	int threads = bits_threads > 0 ? bits_threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+	struct BitsTask *tasks;
+	pthread_t *tids;
+	bool *started;
+	double avg;
+
+	if (threads > n / PAR_MIN) {
+		threads = n / PAR_MIN;
+	}
+	if (threads < 2) {
+		return avg_bits(data, n);
+	}
+
+	tasks = malloc(threads * sizeof(struct BitsTask));
+	tids = malloc(threads * sizeof(pthread_t));
+	started = malloc(threads * sizeof(bool));
+
+	for (int t = 0; t < threads; t++){
+		int lo = (int) ((int64_t) n * t / threads);
+		int hi = (int) ((int64_t) n * (t + 1) / threads);
+
+		tasks[t].data = data + lo;
+		tasks[t].n = hi - lo;
+		started[t] = pthread_create(&tids[t], NULL, bits_worker, &tasks[t]) == 0;
+
+		// Out of threads, do this slice on the calling thread instead.
+		if (!started[t]) {
+			bits_worker(&tasks[t]);
+		}
+	}
+
+	for (int t = 0; t < threads; t++){
+		if (started[t]) {
+			pthread_join(tids[t], NULL);
+		}
+		if (t > 0) {
+			bits_merge(&tasks[0].acc, &tasks[t].acc);
+		}
+	}
+	avg = bits_finalize(&tasks[0].acc);
+
+	free(tasks);
+	free(tids);
+	free(started);
+	return avg;
+}
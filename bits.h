@@ -0,0 +1,189 @@
+#ifndef DOUBLES_BITS_H
+#define DOUBLES_BITS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Constants for extracting floating point fields from a double
+#define SIGN (1ll << 63)
+#define EXP (0x7FFll << 52)
+#define FRAC ~(0xFFFll << 52)
+
+// Implied leading 1 for adding to normalized fractions.
+#define ONE (1ll << 52)
+
+// The shift and index constants for breaking up a faction field into sums
+#define SHIFT 0x3ll
+#define IND 0x7FCll
+
+// The sums array will contain an integer value representing accumulated
+// fractional fields. The index represents the exponent value. There are 16 + 1
+// buffer cells to hold overflow values. Cell i counts units of 2^(4i - 1075).
+#define NUM_SIZES (512 + 16)
+
+// 32 bit digits needed for the magnitude of normalized cells, including the
+// top cell's excess.
+#define NUM_DIGITS (NUM_SIZES / 8 + 2)
+
+// Smallest slice of the input worth handing to its own thread.
+#define PAR_MIN (1 << 14)
+
+// Elements a carry-save accumulator takes between carry_cells passes. Each
+// element adds at most 15 to a cell, so this stays far inside the int64_t
+// headroom above INT52.
+#define DEFER_NORM (1 << 30)
+
+#define INT52_MAX ((1ll << 52) - 1)
+#define INT52_MIN -(1ll << 52)
+
+// Views of the same 64 bits as integers or a double.
+union Data64 {
+	uint64_t b:7;
+    uint64_t u;
+    int64_t i;
+    double f;
+    char bytes[8];
+};
+
+// compute_sums kernels, selected through bits_kernel.
+enum {
+	KERNEL_AUTO,
+	KERNEL_SCALAR,
+	KERNEL_AVX2,
+	KERNEL_AVX512
+};
+
+typedef void (*sums_kernel)(const double *data, int64_t *sums, int n, int *lo, int *hi);
+
+// Precomputed reciprocal of a fixed divisor, so every digit of the long division
+// in round_mean is a multiply and a shift instead of a hardware divide.
+struct Divider {
+	uint64_t d;
+	uint64_t magic;
+	int shift;
+};
+
+static inline uint64_t divide(uint64_t x, const struct Divider *div) {
+	uint64_t q, t;
+
+	if (!div->magic) {
+		return x >> div->shift;
+	}
+	q = (uint64_t) (((unsigned __int128) x * div->magic) >> 64);
+	t = ((x - q) >> 1) + q;
+	return t >> div->shift;
+}
+
+// Rounding modes for the exact mean.
+enum {
+	ROUND_NEAREST,
+	ROUND_UP,
+	ROUND_DOWN,
+	ROUND_ZERO
+};
+
+// Canonical form of an exact sum, a sign and a magnitude in 32 bit digits of
+// units of 2^-1075, least significant first.
+struct BigFix {
+	uint32_t d[NUM_DIGITS];
+	int len;
+	bool neg;
+};
+
+// Streaming form of avg_bits. The accumulator owns the sums cells, so data can
+// be added in chunks of any size and the exact mean read back whenever it is
+// needed, without ever holding the whole series in memory. Setting deferred
+// after bits_init switches to carry-save adds, where the overflow checks are
+// replaced by a carry_cells pass every DEFER_NORM elements. Every cell outside
+// the window [lo, hi] is zero, so the sweeps in bits_finalize skip them and
+// bits_reset only clears the window.
+struct BitsAcc {
+	int64_t sums[NUM_SIZES];
+	int64_t n;
+	bool deferred;
+	int64_t pending;
+	int lo, hi;
+};
+
+// Hot path counters, compiled in only with BITS_STATS defined (the BITS_STATS
+// cmake option) and free otherwise. They are kept per thread, so the parallel
+// engine's workers are not counted.
+#ifdef BITS_STATS
+#include <time.h>
+
+struct BitsStats {
+	// recursive_add calls, and the elements the SIMD kernels added in one
+	// vector step instead.
+	int64_t adds;
+	int64_t vec_adds;
+	int64_t carries;
+	int max_depth;
+	int64_t sweeps;
+	// Digit steps of the long division in round_quotient, which replaced the
+	// shift iterations of the original percolation pass.
+	int64_t div_steps;
+	int lo, hi;
+	double sums_ns;
+	double avg_ns;
+};
+
+extern _Thread_local struct BitsStats bits_stats;
+
+void bits_stats_reset(void);
+
+static inline double stats_now(void) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+#define STATS_ADD(field, x) (bits_stats.field += (x))
+#define STATS_MAX(field, x) (bits_stats.field = (x) > bits_stats.field ? (x) : bits_stats.field)
+#define STATS_SET(field, x) (bits_stats.field = (x))
+#define STATS_TIME(t) double t = stats_now()
+#else
+#define STATS_ADD(field, x) ((void) 0)
+#define STATS_MAX(field, x) ((void) 0)
+#define STATS_SET(field, x) ((void) 0)
+#define STATS_TIME(t) ((void) 0)
+#endif
+
+void bits_init(struct BitsAcc *acc);
+void bits_reset(struct BitsAcc *acc);
+void bits_add_chunk(struct BitsAcc *acc, const double *data, int n);
+void bits_add_weighted(struct BitsAcc *acc, const double *data, const int64_t *mult, int n);
+double bits_finalize(const struct BitsAcc *acc);
+double bits_finalize_rounded(const struct BitsAcc *acc, int mode);
+void bits_merge(struct BitsAcc *dst, const struct BitsAcc *src);
+void bits_sum_fix(const struct BitsAcc *acc, struct BigFix *fix);
+
+int64_t recursive_add_sized(int64_t *cells, int size, int64_t ind, int64_t x);
+int64_t recursive_add(int64_t *cells, int64_t ind, int64_t x);
+void carry_cells(int64_t *cells, int lo, int *hi);
+void normalize_cells(int64_t *cells, int *lo, int *hi);
+void merge_cells(int64_t *dst, int *dst_lo, int *dst_hi, const int64_t *src, int src_lo, int src_hi);
+void compute_sums_scalar(const double *data, int64_t *sums, int n, int *lo, int *hi);
+void compute_sums(const double *data, int64_t *sums, int n, int *lo, int *hi);
+int64_t add_product(int64_t *cells, int64_t ind, unsigned __int128 p, int64_t sign);
+void compute_sums_weighted(const double *data, const int64_t *mult, int64_t *sums, int n, int *lo, int *hi);
+void compute_sums_deferred_scalar(const double *data, int64_t *sums, int n, int *lo, int *hi);
+void compute_sums_deferred(const double *data, int64_t *sums, int n, int *lo, int *hi);
+void make_divider(struct Divider *div, uint64_t d);
+void cells_to_fix(const int64_t *cells, int lo, int hi, struct BigFix *fix);
+unsigned __int128 round_quotient(const uint32_t *d, int len, bool neg, int64_t n, int mode, int prec, int *lsb);
+double round_mean(const struct BigFix *sum, int64_t n, int mode);
+double compute_avg(const int64_t *sums, int64_t n, int lo, int hi, int mode);
+double avg_bits(const double *data, int n);
+double avg_bits_deferred(const double *data, int n);
+double avg_bits_scalar(const double *data, int n);
+double avg_bits_avx2(const double *data, int n);
+double avg_bits_avx512(const double *data, int n);
+
+extern int bits_kernel;
+sums_kernel simd_kernel(int kernel, bool deferred);
+
+extern int bits_threads;
+double avg_bits_parallel(const double *data, int n);
+
+#endif //DOUBLES_BITS_H
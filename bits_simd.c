@@ -0,0 +1,206 @@
+#include "bits.h"
+
+// Vectorized compute_sums kernels. The sign, exponent and fraction of 4 (AVX2)
+// or 8 (AVX-512) doubles are pulled apart at once, then the 14 nibbles of each
+// shifted fraction are added to their 14 neighbouring cells with one 16 lane
+// vector add. Any element whose add would push a cell past the INT52 bounds
+// goes through recursive_add instead, so the cells end up exactly as the
+// scalar kernel leaves them. The deferred kernels skip that check entirely and
+// leave the carries to carry_cells.
+
+#if defined(__GNUC__) && defined(__x86_64__)
+
+#include <immintrin.h>
+
+// Slow path for an element that would overflow a cell, returns the highest
+// cell its carries reached.
+static int64_t add_nibbles_scalar(int64_t *sums, int64_t ind, int64_t frac, int64_t sign) {
+	int64_t top, high = ind;
+
+	for (int j = 0; j <= 13; j++){
+		top = recursive_add(sums, ind + j, ((frac >> (j * 4)) & 0xF) * (sign ? -1 : 1));
+		high = top > high ? top : high;
+	}
+	return high;
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline int64_t add_nibbles_avx2(int64_t *sums, int64_t ind, int64_t frac, int64_t sign, bool check) {
+	const __m256i mask = _mm256_set1_epi64x(0xF);
+	const __m256i neg = _mm256_set1_epi64x(sign);
+	const __m256i max = _mm256_set1_epi64x(INT52_MAX);
+	const __m256i min = _mm256_set1_epi64x(INT52_MIN);
+	__m256i f = _mm256_set1_epi64x(frac);
+	__m256i sh = _mm256_set_epi64x(12, 8, 4, 0);
+	__m256i x[4], s[4], over = _mm256_setzero_si256();
+
+	for (int k = 0; k < 4; k++){
+		x[k] = _mm256_and_si256(_mm256_srlv_epi64(f, sh), mask);
+		x[k] = _mm256_sub_epi64(_mm256_xor_si256(x[k], neg), neg);
+		s[k] = _mm256_add_epi64(_mm256_loadu_si256((__m256i *) (sums + ind + 4 * k)), x[k]);
+		over = _mm256_or_si256(over, _mm256_cmpgt_epi64(s[k], max));
+		over = _mm256_or_si256(over, _mm256_cmpgt_epi64(min, s[k]));
+		sh = _mm256_add_epi64(sh, _mm256_set1_epi64x(16));
+	}
+
+	if (!check || _mm256_testz_si256(over, over)) {
+		for (int k = 0; k < 4; k++){
+			_mm256_storeu_si256((__m256i *) (sums + ind + 4 * k), s[k]);
+		}
+		STATS_ADD(vec_adds, 1);
+		return ind + 13;
+	}
+	return add_nibbles_scalar(sums, ind, frac, sign);
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline void sums_avx2(const double *data, int64_t *sums, int n, int *lo, int *hi, bool check) {
+	const __m256i exp_mask = _mm256_set1_epi64x(0x7FF);
+	const __m256i frac_mask = _mm256_set1_epi64x(FRAC);
+	const __m256i one = _mm256_set1_epi64x(ONE);
+	const __m256i shift_mask = _mm256_set1_epi64x(SHIFT);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i min_exp = _mm256_set1_epi64x(1);
+	int64_t ind[4], frac[4], sign[4], top;
+	int i = 0, low = *lo, high = *hi;
+
+	for (; i + 4 <= n; i += 4){
+		__m256i u = _mm256_loadu_si256((const __m256i *) (data + i));
+		__m256i exp = _mm256_and_si256(_mm256_srli_epi64(u, 52), exp_mask);
+		__m256i f = _mm256_and_si256(u, frac_mask);
+
+		// Implied leading one for normalized fractions, then the pre-shift.
+		f = _mm256_or_si256(f, _mm256_andnot_si256(_mm256_cmpeq_epi64(exp, zero), one));
+
+		// Subnormals share the scale of the smallest normal exponent.
+		exp = _mm256_max_epi32(exp, min_exp);
+		f = _mm256_sllv_epi64(f, _mm256_and_si256(exp, shift_mask));
+
+		_mm256_storeu_si256((__m256i *) ind, _mm256_srli_epi64(exp, 2));
+		_mm256_storeu_si256((__m256i *) frac, f);
+		_mm256_storeu_si256((__m256i *) sign, _mm256_cmpgt_epi64(zero, u));
+
+		for (int k = 0; k < 4; k++){
+			top = add_nibbles_avx2(sums, ind[k], frac[k], sign[k], check);
+			low = ind[k] < low ? (int) ind[k] : low;
+			high = top > high ? (int) top : high;
+		}
+	}
+	*lo = low;
+	*hi = high;
+
+	if (check) {
+		compute_sums_scalar(data + i, sums, n - i, lo, hi);
+	} else {
+		compute_sums_deferred_scalar(data + i, sums, n - i, lo, hi);
+	}
+}
+
+__attribute__((target("avx2")))
+static void compute_sums_avx2(const double *data, int64_t *sums, int n, int *lo, int *hi) {
+	sums_avx2(data, sums, n, lo, hi, true);
+}
+
+__attribute__((target("avx2")))
+static void compute_sums_avx2_deferred(const double *data, int64_t *sums, int n, int *lo, int *hi) {
+	sums_avx2(data, sums, n, lo, hi, false);
+}
+
+__attribute__((target("avx512f"), always_inline))
+static inline int64_t add_nibbles_avx512(int64_t *sums, int64_t ind, int64_t frac, int64_t sign, bool check) {
+	const __m512i mask = _mm512_set1_epi64(0xF);
+	const __m512i neg = _mm512_set1_epi64(sign);
+	const __m512i max = _mm512_set1_epi64(INT52_MAX);
+	const __m512i min = _mm512_set1_epi64(INT52_MIN);
+	__m512i f = _mm512_set1_epi64(frac);
+	__m512i sh = _mm512_set_epi64(28, 24, 20, 16, 12, 8, 4, 0);
+	__m512i x[2], s[2];
+	__mmask8 over = 0;
+
+	for (int k = 0; k < 2; k++){
+		x[k] = _mm512_and_si512(_mm512_srlv_epi64(f, sh), mask);
+		x[k] = _mm512_sub_epi64(_mm512_xor_si512(x[k], neg), neg);
+		s[k] = _mm512_add_epi64(_mm512_loadu_si512(sums + ind + 8 * k), x[k]);
+		over |= _mm512_cmpgt_epi64_mask(s[k], max) | _mm512_cmplt_epi64_mask(s[k], min);
+		sh = _mm512_add_epi64(sh, _mm512_set1_epi64(32));
+	}
+
+	if (!check || !over) {
+		_mm512_storeu_si512(sums + ind, s[0]);
+		_mm512_storeu_si512(sums + ind + 8, s[1]);
+		STATS_ADD(vec_adds, 1);
+		return ind + 13;
+	}
+	return add_nibbles_scalar(sums, ind, frac, sign);
+}
+
+__attribute__((target("avx512f"), always_inline))
+static inline void sums_avx512(const double *data, int64_t *sums, int n, int *lo, int *hi, bool check) {
+	const __m512i exp_mask = _mm512_set1_epi64(0x7FF);
+	const __m512i frac_mask = _mm512_set1_epi64(FRAC);
+	const __m512i one = _mm512_set1_epi64(ONE);
+	const __m512i shift_mask = _mm512_set1_epi64(SHIFT);
+	const __m512i zero = _mm512_setzero_si512();
+	const __m512i min_exp = _mm512_set1_epi64(1);
+	int64_t ind[8], frac[8], sign[8], top;
+	int i = 0, low = *lo, high = *hi;
+
+	for (; i + 8 <= n; i += 8){
+		__m512i u = _mm512_loadu_si512(data + i);
+		__m512i exp = _mm512_and_si512(_mm512_srli_epi64(u, 52), exp_mask);
+		__m512i f = _mm512_and_si512(u, frac_mask);
+
+		// Implied leading one for normalized fractions, then the pre-shift.
+		f = _mm512_mask_or_epi64(f, _mm512_cmpneq_epi64_mask(exp, zero), f, one);
+
+		// Subnormals share the scale of the smallest normal exponent.
+		exp = _mm512_max_epu64(exp, min_exp);
+		f = _mm512_sllv_epi64(f, _mm512_and_si512(exp, shift_mask));
+
+		_mm512_storeu_si512(ind, _mm512_srli_epi64(exp, 2));
+		_mm512_storeu_si512(frac, f);
+		_mm512_storeu_si512(sign, _mm512_srai_epi64(u, 63));
+
+		for (int k = 0; k < 8; k++){
+			top = add_nibbles_avx512(sums, ind[k], frac[k], sign[k], check);
+			low = ind[k] < low ? (int) ind[k] : low;
+			high = top > high ? (int) top : high;
+		}
+	}
+	*lo = low;
+	*hi = high;
+
+	if (check) {
+		compute_sums_scalar(data + i, sums, n - i, lo, hi);
+	} else {
+		compute_sums_deferred_scalar(data + i, sums, n - i, lo, hi);
+	}
+}
+
+__attribute__((target("avx512f")))
+static void compute_sums_avx512(const double *data, int64_t *sums, int n, int *lo, int *hi) {
+	sums_avx512(data, sums, n, lo, hi, true);
+}
+
+__attribute__((target("avx512f")))
+static void compute_sums_avx512_deferred(const double *data, int64_t *sums, int n, int *lo, int *hi) {
+	sums_avx512(data, sums, n, lo, hi, false);
+}
+
+sums_kernel simd_kernel(int kernel, bool deferred) {
+	if ((kernel == KERNEL_AUTO || kernel == KERNEL_AVX512) && __builtin_cpu_supports("avx512f")) {
+		return deferred ? compute_sums_avx512_deferred : compute_sums_avx512;
+	}
+	if ((kernel == KERNEL_AUTO || kernel == KERNEL_AVX2) && __builtin_cpu_supports("avx2")) {
+		return deferred ? compute_sums_avx2_deferred : compute_sums_avx2;
+	}
+	return NULL;
+}
+
+#else
+
+sums_kernel simd_kernel(int kernel, bool deferred) {
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,246 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decimal.h"
+
+// The sum counts units of 2^-FIX_SCALE.
+#define FIX_SCALE 1075
+
+// Where the bits shifted out of a big integer fall against half of their
+// place.
+enum {
+	LOW_ZERO,
+	LOW_BELOW,
+	LOW_HALF,
+	LOW_ABOVE
+};
+
+// Big integers here are len 32 bit digits, least significant first, without
+// leading zero digits.
+
+// a *= m, returns the new length. a needs room for one more digit.
+static int big_mul_small(uint32_t *a, int len, uint32_t m) {
+	uint64_t carry = 0;
+
+	for (int k = 0; k < len; k++){
+		carry += (uint64_t) a[k] * m;
+		a[k] = (uint32_t) carry;
+		carry >>= 32;
+	}
+	if (carry) {
+		a[len++] = (uint32_t) carry;
+	}
+	return len;
+}
+
+// a /= d, returns the remainder.
+static uint64_t big_div_small(uint32_t *a, int *len, uint64_t d) {
+	unsigned __int128 r = 0;
+
+	for (int k = *len - 1; k >= 0; k--){
+		r = (r << 32) | a[k];
+		a[k] = (uint32_t) (r / d);
+		r %= d;
+	}
+	while (*len > 0 && a[*len - 1] == 0) {
+		(*len)--;
+	}
+	return (uint64_t) r;
+}
+
+// How the low s bits of a compare with 2^(s - 1).
+static int big_low(const uint32_t *a, int len, int s) {
+	int k = (s - 1) >> 5;
+	uint32_t bit = 1u << ((s - 1) & 31);
+	bool half = k < len && (a[k] & bit);
+	bool rest = k < len && (a[k] & (bit - 1));
+
+	for (int j = 0; j < k && j < len && !rest; j++){
+		rest = a[j] != 0;
+	}
+	return half ? (rest ? LOW_ABOVE : LOW_HALF) : (rest ? LOW_BELOW : LOW_ZERO);
+}
+
+// a >>= s, returns the new length.
+static int big_shr(uint32_t *a, int len, int s) {
+	int k = s >> 5, b = s & 31;
+
+	if (k >= len) {
+		return 0;
+	}
+	for (int j = 0; j + k < len; j++){
+		uint64_t x = a[j + k] | (j + k + 1 < len ? (uint64_t) a[j + k + 1] << 32 : 0);
+		a[j] = (uint32_t) (x >> b);
+	}
+	len -= k;
+	while (len > 0 && a[len - 1] == 0) {
+		len--;
+	}
+	return len;
+}
+
+// Number of trailing zero bits of a non zero a.
+static int big_ctz(const uint32_t *a) {
+	int k = 0;
+
+	while (a[k] == 0) {
+		k++;
+	}
+	return 32 * k + __builtin_ctz(a[k]);
+}
+
+// Decimal digits of a, which is destroyed, into out with room for 10 per
+// digit of a. Returns the number of digits written, without a terminator.
+static int big_to_text(uint32_t *a, int len, char *out) {
+	uint32_t chunk;
+	int pos = 0;
+	char c;
+
+	// Nine digits at a time, least significant first.
+	do {
+		chunk = (uint32_t) big_div_small(a, &len, 1000000000);
+		for (int k = 0; k < 9 && (len > 0 || chunk); k++){
+			out[pos++] = (char) ('0' + chunk % 10);
+			chunk /= 10;
+		}
+	} while (len > 0);
+	if (pos == 0) {
+		out[pos++] = '0';
+	}
+
+	for (int k = 0; k < pos / 2; k++){
+		c = out[k];
+		out[k] = out[pos - 1 - k];
+		out[pos - 1 - k] = c;
+	}
+	return pos;
+}
+
+// Multiply the sum by 10^places, divide by n * 2^1075 and round the quotient
+// half to even, then print it with the point places digits from the right.
+// The remainder against half the divisor is (2r - n) 2^1075 + 2b, for the
+// remainder r of the division by n and the bits b shifted out before it.
+char *fix_decimal(const struct BigFix *sum, int64_t n, int places) {
+	static const uint32_t pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+	int len = sum->len, cap = sum->len + places / 9 + 2, low, digits, width, pos = 0, k;
+	uint32_t *a = malloc(cap * sizeof(uint32_t));
+	char *num = malloc(10 * cap), *text = malloc(10 * cap + places + 4);
+	__int128 d;
+	bool up;
+
+	if (!a || !num || !text) {
+		free(a);
+		free(num);
+		free(text);
+		return NULL;
+	}
+	memcpy(a, sum->d, len * sizeof(uint32_t));
+
+	for (int p = places; p > 0; p -= 9){
+		len = big_mul_small(a, len, pow10[p < 9 ? p : 9]);
+	}
+	low = big_low(a, len, FIX_SCALE);
+	len = big_shr(a, len, FIX_SCALE);
+	d = 2 * (__int128) big_div_small(a, &len, n) - n;
+
+	up = d > 0 || (d == 0 && low != LOW_ZERO) || (d == -1 && low == LOW_ABOVE);
+	if ((d == 0 && low == LOW_ZERO) || (d == -1 && low == LOW_HALF)) {
+		up = len > 0 && (a[0] & 1);
+	}
+	if (up) {
+		for (k = 0; k < len && ++a[k] == 0; k++);
+		if (k == len) {
+			a[len++] = 1;
+		}
+	}
+	digits = big_to_text(a, len, num);
+	free(a);
+
+	// Zero padded to at least one digit before the point.
+	width = digits > places ? digits : places + 1;
+	if (sum->neg) {
+		text[pos++] = '-';
+	}
+	for (k = 0; k < width; k++){
+		if (width - k == places) {
+			text[pos++] = '.';
+		}
+		text[pos++] = k < width - digits ? '0' : num[k - width + digits];
+	}
+	text[pos] = '\0';
+	free(num);
+	return text;
+}
+
+// Cancel the powers of two first, then the gcd with the odd part of n.
+char *fix_rational(const struct BigFix *sum, int64_t n) {
+	int len = sum->len, zeros, shift, rem_len, den_len;
+	uint64_t odd, a, b, g;
+	uint32_t *num, *den, *rem;
+	char *text;
+	int pos = 0;
+
+	if (len == 0) {
+		return strdup("0");
+	}
+
+	zeros = __builtin_ctzll(n);
+	odd = (uint64_t) n >> zeros;
+	shift = FIX_SCALE + zeros;
+
+	num = malloc(len * sizeof(uint32_t));
+	rem = malloc(len * sizeof(uint32_t));
+	den = calloc(shift / 32 + 3, sizeof(uint32_t));
+	text = malloc(10 * (len + shift / 32 + 3) + 3);
+	if (!num || !rem || !den || !text) {
+		free(num);
+		free(rem);
+		free(den);
+		free(text);
+		return NULL;
+	}
+
+	memcpy(num, sum->d, len * sizeof(uint32_t));
+	zeros = big_ctz(num);
+	zeros = zeros < shift ? zeros : shift;
+	len = big_shr(num, len, zeros);
+	shift -= zeros;
+
+	memcpy(rem, num, len * sizeof(uint32_t));
+	rem_len = len;
+	a = odd;
+	b = big_div_small(rem, &rem_len, odd);
+	while (b) {
+		g = a % b;
+		a = b;
+		b = g;
+	}
+	big_div_small(num, &len, a);
+	odd /= a;
+
+	// The denominator odd * 2^shift.
+	den_len = shift / 32 + 3;
+	den[shift / 32] = (uint32_t) (odd << (shift & 31));
+	den[shift / 32 + 1] = (uint32_t) (((unsigned __int128) odd << (shift & 31)) >> 32);
+	den[shift / 32 + 2] = (uint32_t) (((unsigned __int128) odd << (shift & 31)) >> 64);
+	while (den[den_len - 1] == 0) {
+		den_len--;
+	}
+
+	if (sum->neg) {
+		text[pos++] = '-';
+	}
+	pos += big_to_text(num, len, text + pos);
+	if (den_len > 1 || den[0] != 1) {
+		text[pos++] = '/';
+		pos += big_to_text(den, den_len, text + pos);
+	}
+	text[pos] = '\0';
+
+	free(num);
+	free(rem);
+	free(den);
+	return text;
+}
@@ -0,0 +1,23 @@
+#ifndef DOUBLES_DECIMAL_H
+#define DOUBLES_DECIMAL_H
+
+#include <stdint.h>
+
+#include "bits.h"
+
+// Digits after the point in the "avg:" header testing.py writes.
+#define AVG_PLACES 60
+
+// Exact text forms of the mean sum / n of an exact sum in units of 2^-1075,
+// as bits_sum_fix gives it. Both return a string to free, or NULL when out of
+// memory.
+
+// The mean rounded half to even to places digits after the point, the same
+// digits Python prints for "{0:.60f}".format(Decimal(sum) / n) with places
+// 60. A negative mean keeps its sign even when it rounds to zero.
+char *fix_decimal(const struct BigFix *sum, int64_t n, int places);
+
+// The mean as a reduced fraction "p/q", or just "p" when q is 1.
+char *fix_rational(const struct BigFix *sum, int64_t n);
+
+#endif //DOUBLES_DECIMAL_H
@@ -0,0 +1,117 @@
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "adaptive.h"
+#include "bits.h"
+#include "engines.h"
+#include "limbs.h"
+#include "online.h"
+#include "wide.h"
+
+// Comparison functions.
+int cmp(const void *ap, const void *bp) {
+	double a = *(double *)ap;
+	double b = *(double *)bp;
+	if (b == a) {
+		return 0;
+	}
+	return (a > b ? 1 : -1);
+}
+
+int cmp_inv(const void *ap, const void *bp) {
+	return cmp(ap, bp) * -1;
+}
+
+int cmp_abs(const void *ap, const void *bp) {
+	double a = *(double *)ap;
+	double b = *(double *)bp;
+	if (b == a) {
+		return 0;
+	}
+	return (a*a > b*b ? 1 : -1);
+}
+
+// Simply adds the doubles and then divides the sum by n.
+double avg_naive(const double *data, int n){
+	double sum = 0.0;
+	for (int i = 0; i < n; i++){
+		sum += data[i];
+	}
+	return sum / (double ) n;
+}
+
+// Same as naive solution but now is now overflow proof.
+double avg_overflow(const double *data, int n){
+	double avg = 0.0;
+	double sum = 0.0;
+	double nd = (double) n;
+
+	double val, rem, max, min;
+	for (int i = 0; i < n; i++){
+		val = data[i];
+
+		max = sum > val ? sum : val;
+		min = sum < val ? sum : val;
+
+		if (min + max == (double) INFINITY) {
+			rem = fmod(max, nd);
+			avg += max / nd;
+			if (rem + min == (double) INFINITY) {
+				rem += fmod(min, nd);
+				avg += min / nd;
+				sum = rem;
+				continue;
+			}
+			sum = min + rem;
+			continue;
+		}
+		sum = min + max;
+	}
+	avg += sum / nd;
+
+	return avg;
+}
+
+const struct Engine engines[] = {
+	{"bits", avg_bits},
+	{"deferred", avg_bits_deferred},
+	{"bits-scalar", avg_bits_scalar},
+	{"bits-avx2", avg_bits_avx2},
+	{"bits-avx512", avg_bits_avx512},
+	{"parallel", avg_bits_parallel},
+	{"limbs", avg_limbs},
+	{"wide", avg_wide},
+	{"adaptive", avg_adaptive},
+	{"online", avg_online},
+	{"naive", avg_naive},
+	{"overflow", avg_overflow},
+};
+const int num_engines = sizeof(engines) / sizeof(engines[0]);
+
+// A NULL comparison leaves the trace in file order.
+const struct Ordering orderings[] = {
+	{"none", NULL},
+	{"cmp", cmp},
+	{"cmp_inv", cmp_inv},
+	{"cmp_abs", cmp_abs},
+};
+const int num_orderings = sizeof(orderings) / sizeof(orderings[0]);
+
+const struct Engine *find_engine(const char *name) {
+	for (int i = 0; i < num_engines; i++){
+		if (strcmp(name, engines[i].name) == 0) {
+			return &engines[i];
+		}
+	}
+	return NULL;
+}
+
+const struct Ordering *find_ordering(const char *name) {
+	for (int i = 0; i < num_orderings; i++){
+		if (strcmp(name, orderings[i].name) == 0) {
+			return &orderings[i];
+		}
+	}
+	return NULL;
+}
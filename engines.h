@@ -0,0 +1,35 @@
+#ifndef DOUBLES_ENGINES_H
+#define DOUBLES_ENGINES_H
+
+typedef double (*avg_func)(const double*, int);
+typedef int (*cmp_func)(const void * ap, const void * bp);
+
+// Averaging engines and input orderings selectable by name, shared by the
+// trace harness and the benchmark driver.
+struct Engine {
+	const char *name;
+	avg_func func;
+};
+
+struct Ordering {
+	const char *name;
+	cmp_func func;
+};
+
+extern const struct Engine engines[];
+extern const int num_engines;
+
+extern const struct Ordering orderings[];
+extern const int num_orderings;
+
+const struct Engine *find_engine(const char *name);
+const struct Ordering *find_ordering(const char *name);
+
+int cmp(const void *ap, const void *bp);
+int cmp_inv(const void *ap, const void *bp);
+int cmp_abs(const void *ap, const void *bp);
+
+double avg_naive(const double *data, int n);
+double avg_overflow(const double *data, int n);
+
+#endif //DOUBLES_ENGINES_H
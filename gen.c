@@ -0,0 +1,448 @@
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bits.h"
+#include "decimal.h"
+#include "trace.h"
+
+// Values per block. Every block draws from its own generator seeded by the
+// seed and the block number, so the output does not depend on the thread
+// count, and a block is the unit one thread generates and formats at a time.
+#define GEN_BLOCK (1 << 16)
+
+// Longest "%.17g\n" line, "-2.2250738585072014e-308\n".
+#define GEN_LINE 26
+
+#define MAX_PARAMS 4
+
+// The distributions of testing.py's callback(), plus adversarial ones: range
+// spans every normal exponent, cancel hides small values between huge ones
+// that cancel, and subnormal is mostly subnormals.
+enum {
+	DIST_RAND,
+	DIST_UNI,
+	DIST_TRI,
+	DIST_GAUSS,
+	DIST_SINE,
+	DIST_TAN,
+	DIST_RANGE,
+	DIST_CANCEL,
+	DIST_SUBNORMAL
+};
+
+struct Dist {
+	const char *name;
+	int kind;
+	int num_params;
+	double defaults[MAX_PARAMS];
+	const char *usage;
+};
+
+static const struct Dist dists[] = {
+	{"rand", DIST_RAND, 0, {0}, ""},
+	{"uni", DIST_UNI, 2, {0, 1}, "[a b]"},
+	{"tri", DIST_TRI, 3, {0, 1, 0.5}, "[low high mode]"},
+	{"gauss", DIST_GAUSS, 2, {0, 1}, "[mu sigma]"},
+	{"sine", DIST_SINE, 4, {0.001, 0, 1, 0}, "[freq phase amp shift]"},
+	{"tan", DIST_TAN, 4, {0.001, 0, 1, 0}, "[freq phase amp shift]"},
+	{"range", DIST_RANGE, 2, {-1022, 1023}, "[min exp max exp]"},
+	{"cancel", DIST_CANCEL, 1, {100}, "[max exp]"},
+	{"subnormal", DIST_SUBNORMAL, 0, {0}, ""},
+};
+
+#define NUM_DISTS ((int) (sizeof(dists) / sizeof(dists[0])))
+
+struct Rng {
+	uint64_t s[4];
+};
+
+// One block of the output. In a text pass the values are also formatted into
+// text, and acc, when set, sums them.
+struct GenJob {
+	const struct Dist *dist;
+	const double *params;
+	uint64_t seed;
+	int64_t start;
+	int count;
+	double *values;
+	char *text;
+	size_t len;
+	struct BitsAcc *acc;
+	bool format;
+	bool started;
+	pthread_t thread;
+};
+
+static uint64_t splitmix64(uint64_t *x) {
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+static void rng_seed(struct Rng *rng, uint64_t seed, uint64_t block) {
+	uint64_t x = seed ^ splitmix64(&block);
+
+	for (int k = 0; k < 4; k++){
+		rng->s[k] = splitmix64(&x);
+	}
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+// xoshiro256**.
+static inline uint64_t rng_next(struct Rng *rng) {
+	uint64_t *s = rng->s, r = rotl(s[1] * 5, 7) * 9, t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+	return r;
+}
+
+// Uniform in [0, 1).
+static inline double rng_unit(struct Rng *rng) {
+	return (double) (rng_next(rng) >> 11) * 0x1p-53;
+}
+
+// Uniform integer in [lo, hi].
+static inline int rng_int(struct Rng *rng, int lo, int hi) {
+	return lo + (int) (((unsigned __int128) rng_next(rng) * (uint64_t) (hi - lo + 1)) >> 64);
+}
+
+// Random sign and mantissa at a random exponent in [lo, hi].
+static inline double rng_wide(struct Rng *rng, int lo, int hi) {
+	uint64_t bits = rng_next(rng);
+	double x = ldexp(1.0 + (double) (bits >> 12) * 0x1p-52, rng_int(rng, lo, hi));
+
+	return bits & 1 ? -x : x;
+}
+
+static void gen_values(const struct GenJob *job) {
+	const double *p = job->params;
+	struct Rng rng;
+	double u, c, lo, hi, r, big = 0;
+	union Data64 val;
+
+	rng_seed(&rng, job->seed, (uint64_t) job->start / GEN_BLOCK);
+
+	for (int i = 0; i < job->count; i++){
+		double x = (double) (job->start + i);
+
+		switch (job->dist->kind) {
+		case DIST_UNI:
+			job->values[i] = p[0] + (p[1] - p[0]) * rng_unit(&rng);
+			break;
+		case DIST_TRI:
+			// Inverse of the distribution function, as random.triangular.
+			u = rng_unit(&rng);
+			lo = p[0];
+			hi = p[1];
+			c = p[1] == p[0] ? 0.5 : (p[2] - p[0]) / (p[1] - p[0]);
+			if (u > c) {
+				u = 1.0 - u;
+				c = 1.0 - c;
+				lo = p[1];
+				hi = p[0];
+			}
+			job->values[i] = lo + (hi - lo) * sqrt(u * c);
+			break;
+		case DIST_GAUSS:
+			// Box-Muller, both values of a pair are used.
+			u = 1.0 - rng_unit(&rng);
+			c = 2 * M_PI * rng_unit(&rng);
+			r = sqrt(-2.0 * log(u));
+			job->values[i] = p[0] + p[1] * r * cos(c);
+			if (i + 1 < job->count) {
+				job->values[++i] = p[0] + p[1] * r * sin(c);
+			}
+			break;
+		case DIST_SINE:
+			job->values[i] = p[2] * sin(x * p[0] + p[1]) + p[3];
+			break;
+		case DIST_TAN:
+			job->values[i] = p[2] * tan(x * p[0] + p[1]) + p[3];
+			break;
+		case DIST_RANGE:
+			job->values[i] = rng_wide(&rng, (int) p[0], (int) p[1]);
+			break;
+		case DIST_CANCEL:
+			// Runs of x, u, -x, u for huge x and u in [0, 1). Blocks start at
+			// multiples of four, so every x meets its negation and only the
+			// u are left of the sum, each added next to a huge partial sum.
+			if (i % 4 == 0) {
+				big = rng_wide(&rng, 0, (int) p[0]);
+			}
+			job->values[i] = i % 2 ? rng_unit(&rng) : i % 4 ? -big : big;
+			break;
+		case DIST_SUBNORMAL:
+			// Seven in eight subnormal, the rest the smallest normals.
+			val.u = rng_next(&rng);
+			if ((val.u & 0xE000000000000ull) != 0) {
+				val.u &= ~EXP;
+			} else {
+				val.u = (val.u & ~EXP) | ((uint64_t) rng_int(&rng, 1, 16) << 52);
+			}
+			job->values[i] = val.f;
+			break;
+		default:
+			job->values[i] = rng_unit(&rng);
+			break;
+		}
+	}
+}
+
+static void *gen_worker(void *arg) {
+	struct GenJob *job = arg;
+
+	gen_values(job);
+	if (job->acc) {
+		bits_add_chunk(job->acc, job->values, job->count);
+	}
+	if (job->format) {
+		job->len = 0;
+		for (int i = 0; i < job->count; i++){
+			job->len += snprintf(job->text + job->len, GEN_LINE + 1, "%.17g\n", job->values[i]);
+		}
+	}
+	return NULL;
+}
+
+// Generate all n values once, a round of threads blocks at a time. The next
+// round is generated while the last one is written, so each slot has two jobs
+// that take turns. When fp is set the blocks are written in order, as text
+// or raw doubles, and the raw ones are folded into checksum. After an error no
+// more threads start, the running ones are still joined.
+static int gen_pass(struct GenJob (*jobs)[2], int threads, int64_t n, FILE *fp, bool text, uint64_t *checksum) {
+	int64_t rounds = (n + (int64_t) threads * GEN_BLOCK - 1) / ((int64_t) threads * GEN_BLOCK);
+	int err = 0;
+
+	for (int64_t r = 0; r <= rounds; r++){
+		int cur = (int) (r & 1), prev = cur ^ 1;
+
+		for (int t = 0; r < rounds && t < threads; t++){
+			struct GenJob *job = &jobs[t][cur];
+
+			job->start = (r * threads + t) * GEN_BLOCK;
+			job->count = job->start < n ? (int) (n - job->start < GEN_BLOCK ? n - job->start : GEN_BLOCK) : 0;
+			job->format = fp && text;
+			job->started = !err && (err = pthread_create(&job->thread, NULL, gen_worker, job)) == 0;
+		}
+		if (r == 0) {
+			continue;
+		}
+
+		for (int t = 0; t < threads; t++){
+			struct GenJob *job = &jobs[t][prev];
+
+			if (!job->started) {
+				continue;
+			}
+			pthread_join(job->thread, NULL);
+			if (!fp || err || job->count == 0) {
+				continue;
+			}
+			if (text) {
+				if (fwrite(job->text, 1, job->len, fp) != job->len) {
+					err = errno ? errno : EIO;
+				}
+			} else {
+				*checksum = trace_checksum_next(*checksum, job->values, job->count);
+				if (fwrite(job->values, sizeof(double), job->count, fp) != (size_t) job->count) {
+					err = errno ? errno : EIO;
+				}
+			}
+		}
+	}
+	return err;
+}
+
+// Write n values as a text trace with the "n:" and "avg:" header, or as a
+// binary trace. The mean needs every value before the header can be written,
+// so text traces are generated twice, once to sum and once to write, while a
+// binary trace is summed as it is written and its header filled in last.
+static int gen_trace(const char *path, const struct Dist *dist, const double *params, int64_t n,
+					 uint64_t seed, int threads, bool binary) {
+	struct GenJob (*jobs)[2] = calloc(threads, sizeof(*jobs));
+	struct BitsAcc *accs = malloc(2 * threads * sizeof(struct BitsAcc));
+	struct TraceHeader header;
+	struct BigFix sum;
+	uint64_t checksum = TRACE_CHECKSUM_INIT;
+	double avg;
+	char *text = NULL;
+	FILE *fp = NULL;
+	int err = 0;
+
+	if (!jobs || !accs) {
+		err = ENOMEM;
+		goto out;
+	}
+	for (int t = 0; t < threads; t++){
+		for (int k = 0; k < 2; k++){
+			struct GenJob *job = &jobs[t][k];
+
+			job->dist = dist;
+			job->params = params;
+			job->seed = seed;
+			job->acc = &accs[2 * t + k];
+			bits_init(job->acc);
+			job->values = malloc(GEN_BLOCK * sizeof(double));
+			job->text = binary ? NULL : malloc((size_t) GEN_BLOCK * GEN_LINE + 1);
+			if (!job->values || (!binary && !job->text)) {
+				err = ENOMEM;
+				goto out;
+			}
+		}
+	}
+
+	if (!(fp = fopen(path, binary ? "wb" : "w"))) {
+		err = errno;
+		goto out;
+	}
+	setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+	if (binary) {
+		memset(&header, 0, sizeof(header));
+		if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+			err = errno ? errno : EIO;
+			goto out;
+		}
+	}
+	if ((err = gen_pass(jobs, threads, n, binary ? fp : NULL, false, &checksum))) {
+		goto out;
+	}
+
+	for (int k = 1; k < 2 * threads; k++){
+		bits_merge(&accs[0], &accs[k]);
+	}
+	avg = bits_finalize(&accs[0]);
+
+	if (binary) {
+		trace_header_init(&header, n, avg, checksum);
+		if (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, fp) != 1) {
+			err = errno ? errno : EIO;
+		}
+	} else {
+		for (int t = 0; t < threads; t++){
+			jobs[t][0].acc = jobs[t][1].acc = NULL;
+		}
+		// The same exact reference refmean and testing.py write, an empty
+		// trace gets a mean of zero.
+		bits_sum_fix(&accs[0], &sum);
+		if (!(text = fix_decimal(&sum, n > 0 ? n : 1, AVG_PLACES))) {
+			err = ENOMEM;
+		} else if (fprintf(fp, "n: %lld\navg: %s\n\n", (long long) n, text) < 0) {
+			err = errno ? errno : EIO;
+		} else {
+			err = gen_pass(jobs, threads, n, fp, true, NULL);
+		}
+	}
+
+out:
+	if (fp && fclose(fp) != 0 && !err) {
+		err = errno;
+	}
+	for (int t = 0; jobs && t < threads; t++){
+		for (int k = 0; k < 2; k++){
+			free(jobs[t][k].values);
+			free(jobs[t][k].text);
+		}
+	}
+	free(jobs);
+	free(accs);
+	free(text);
+	return err;
+}
+
+static void usage(const char *prog) {
+	printf("Usage: %s [-b] [-s seed] [-t threads] <out> <n> <dist> [params]\n", prog);
+	for (int d = 0; d < NUM_DISTS; d++){
+		printf("    %-10s %s\n", dists[d].name, dists[d].usage);
+	}
+}
+
+// gen writes a trace of n values drawn from one of the distributions, as text
+// or with -b as a binary trace, along with its exact mean.
+int main(int argc, char *argv[]) {
+	const struct Dist *dist = NULL;
+	double params[MAX_PARAMS];
+	uint64_t seed = 1;
+	int threads = (int) sysconf(_SC_NPROCESSORS_ONLN), opt, err;
+	bool binary = false;
+	long long n;
+	long num;
+	char *end;
+
+	while ((opt = getopt(argc, argv, "+bs:t:")) != -1) {
+		switch (opt) {
+		case 'b':
+			binary = true;
+			break;
+		case 's':
+			errno = 0;
+			seed = strtoull(optarg, &end, 0);
+			if (errno || end == optarg || *end) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 't':
+			errno = 0;
+			num = strtol(optarg, &end, 10);
+			if (errno || end == optarg || *end || num < 0 || num > INT_MAX) {
+				usage(argv[0]);
+				return 1;
+			}
+			threads = (int) num;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (argc - optind < 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (int d = 0; d < NUM_DISTS; d++){
+		dist = strcmp(argv[optind + 2], dists[d].name) == 0 ? &dists[d] : dist;
+	}
+	errno = 0;
+	n = strtoll(argv[optind + 1], &end, 10);
+	if (!dist || errno || end == argv[optind + 1] || *end || n < 0 || argc - optind - 3 > dist->num_params) {
+		usage(argv[0]);
+		return 1;
+	}
+	// The reader takes binary traces of at most INT32_MAX values.
+	if (binary && n > INT32_MAX) {
+		fprintf(stderr, "binary traces hold at most %d values\n", INT32_MAX);
+		return 1;
+	}
+
+	// Missing parameters keep their defaults.
+	for (int k = 0; k < MAX_PARAMS; k++){
+		params[k] = optind + 3 + k < argc ? atof(argv[optind + 3 + k]) : dist->defaults[k];
+	}
+	threads = threads > 0 ? threads : 1;
+
+	if ((err = gen_trace(argv[optind], dist, params, n, seed, threads, binary))) {
+		fprintf(stderr, "cannot write file '%s': %s\n", argv[optind], strerror(err));
+		return 1;
+	}
+	return 0;
+}
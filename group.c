@@ -0,0 +1,166 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "group.h"
+
+// Slots the table starts with, it doubles whenever it gets half full.
+#define GROUP_MIN_SLOTS 1024
+
+// FNV-1a over the key's bytes.
+static uint32_t hash_key(const char *key, uint32_t len) {
+	uint32_t h = 0x811C9DC5u;
+
+	for (uint32_t i = 0; i < len; i++){
+		h = (h ^ (uint8_t) key[i]) * 0x01000193u;
+	}
+	return h;
+}
+
+static __int128 *group_cells(struct GroupAcc *acc) {
+	return acc->len > GROUP_INLINE ? acc->heap : acc->local;
+}
+
+// Widen the window to cover the cells [lo, hi], keeping what it holds.
+static int widen(struct GroupAcc *acc, int lo, int hi) {
+	__int128 cells[NUM_WIDE], *dst = acc->local;
+	int len;
+
+	if (acc->len) {
+		lo = acc->lo < lo ? acc->lo : lo;
+		hi = acc->lo + acc->len - 1 > hi ? acc->lo + acc->len - 1 : hi;
+	}
+	len = hi - lo + 1;
+
+	memset(cells, 0, len * sizeof(__int128));
+	if (acc->len) {
+		memcpy(cells + acc->lo - lo, group_cells(acc), acc->len * sizeof(__int128));
+	}
+
+	if (len > GROUP_INLINE && !(dst = malloc(len * sizeof(__int128)))) {
+		return ENOMEM;
+	}
+	if (acc->len > GROUP_INLINE) {
+		free(acc->heap);
+	}
+	memcpy(dst, cells, len * sizeof(__int128));
+	if (len > GROUP_INLINE) {
+		acc->heap = dst;
+	}
+	acc->lo = (uint8_t) lo;
+	acc->len = (uint8_t) len;
+	return 0;
+}
+
+static int acc_add(struct GroupAcc *acc, double x) {
+	union Data64 val;
+	__int128 lo, hi, *cells;
+	int k, err;
+
+	acc->n++;
+
+	// Zeros add nothing anywhere, so they do not widen the window.
+	val.f = x;
+	if (!(val.u << 1)) {
+		return 0;
+	}
+
+	k = wide_split(x, &lo, &hi);
+	if (!acc->len || k < acc->lo || k + 1 >= acc->lo + acc->len) {
+		if ((err = widen(acc, k, k + 1)) != 0) {
+			return err;
+		}
+	}
+
+	cells = group_cells(acc);
+	cells[k - acc->lo] += lo;
+	cells[k + 1 - acc->lo] += hi;
+	return 0;
+}
+
+// Double the slots, or allocate the first ones, and place every entry again.
+static int grow_slots(struct GroupTable *table) {
+	uint32_t size = table->slots ? 2 * (table->mask + 1) : GROUP_MIN_SLOTS, i, h;
+	uint64_t *slots = calloc(size, sizeof(uint64_t));
+
+	if (!slots) {
+		return ENOMEM;
+	}
+	for (int e = 0; e < table->num; e++){
+		h = table->entries[e].hash;
+		for (i = h & (size - 1); slots[i]; i = (i + 1) & (size - 1));
+		slots[i] = (uint64_t) h << 32 | (uint32_t) (e + 1);
+	}
+	free(table->slots);
+	table->slots = slots;
+	table->mask = size - 1;
+	return 0;
+}
+
+void group_init(struct GroupTable *table) {
+	table->entries = NULL;
+	table->num = table->cap = 0;
+	table->slots = NULL;
+	table->mask = 0;
+}
+
+void group_free(struct GroupTable *table) {
+	for (int e = 0; e < table->num; e++){
+		if (table->entries[e].acc.len > GROUP_INLINE) {
+			free(table->entries[e].acc.heap);
+		}
+	}
+	free(table->entries);
+	free(table->slots);
+	group_init(table);
+}
+
+int group_add(struct GroupTable *table, const char *key, uint32_t len, double x) {
+	uint32_t h = hash_key(key, len), i;
+	struct GroupEntry *entry;
+	int err;
+
+	if (!table->slots || 2 * (uint32_t) (table->num + 1) > table->mask + 1) {
+		if ((err = grow_slots(table)) != 0) {
+			return err;
+		}
+	}
+
+	for (i = h & table->mask; table->slots[i]; i = (i + 1) & table->mask){
+		if (table->slots[i] >> 32 != h) {
+			continue;
+		}
+		entry = &table->entries[(uint32_t) table->slots[i] - 1];
+		if (entry->key_len == len && memcmp(entry->key, key, len) == 0) {
+			return acc_add(&entry->acc, x);
+		}
+	}
+
+	if (table->num == table->cap) {
+		int cap = table->cap ? 2 * table->cap : GROUP_MIN_SLOTS / 2;
+
+		if (!(entry = realloc(table->entries, cap * sizeof(struct GroupEntry)))) {
+			return ENOMEM;
+		}
+		table->entries = entry;
+		table->cap = cap;
+	}
+
+	entry = &table->entries[table->num];
+	memset(entry, 0, sizeof(*entry));
+	entry->key = key;
+	entry->key_len = len;
+	entry->hash = h;
+	table->slots[i] = (uint64_t) h << 32 | (uint32_t) ++table->num;
+	return acc_add(&entry->acc, x);
+}
+
+double group_mean(const struct GroupAcc *acc) {
+	struct BigFix sum;
+
+	if (acc->n == 0) {
+		return 0.0;
+	}
+	wide_range_to_fix(acc->len > GROUP_INLINE ? acc->heap : acc->local, acc->lo, acc->len, &sum);
+	return round_mean(&sum, acc->n, ROUND_NEAREST);
+}
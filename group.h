@@ -0,0 +1,54 @@
+#ifndef DOUBLES_GROUP_H
+#define DOUBLES_GROUP_H
+
+#include <stdint.h>
+
+#include "wide.h"
+
+// Cells a group keeps inside its own entry before its window moves to the
+// heap. Values sharing one exponent range touch two.
+#define GROUP_INLINE 2
+
+// Compact exact accumulator for one key. It holds only the window of 128 bit
+// wide cells its values have touched, starting at cell lo, and widens it when
+// a value lands outside. Like a WideAcc the cells never carry, so a window of
+// len cells is the whole state, kept in local while it fits.
+struct GroupAcc {
+	union {
+		__int128 local[GROUP_INLINE];
+		__int128 *heap;
+	};
+	int64_t n;
+	uint8_t lo, len;
+};
+
+// A key, pointing into the caller's buffer, with its hash and accumulator.
+struct GroupEntry {
+	const char *key;
+	uint32_t key_len;
+	uint32_t hash;
+	struct GroupAcc acc;
+};
+
+// Open addressing table from key to accumulator. The entries are stored
+// densely in order of first appearance, and each slot holds a key's hash over
+// its entry index + 1, 0 when empty. Probes compare the hash in the slot, so
+// only a likely match reads its entry.
+struct GroupTable {
+	struct GroupEntry *entries;
+	int num, cap;
+	uint64_t *slots;
+	uint32_t mask;
+};
+
+void group_init(struct GroupTable *table);
+void group_free(struct GroupTable *table);
+
+// Add x to the group of the len byte key. The key is not copied and must
+// outlive the table. Returns 0, or ENOMEM.
+int group_add(struct GroupTable *table, const char *key, uint32_t len, double x);
+
+// Exact mean of a group, rounded to nearest even.
+double group_mean(const struct GroupAcc *acc);
+
+#endif //DOUBLES_GROUP_H
@@ -0,0 +1,116 @@
+#include "limbs.h"
+
+// Push every limb's overflow past 32 bits into the next limb up. All limbs but
+// the top one end up in [0, 2^32), the top one keeps the sign of the sum.
+void normalize_limbs(int64_t *limbs) {
+	for (int k = 0; k < NUM_LIMBS - 1; k++){
+		limbs[k + 1] += limbs[k] >> LIMB_BITS;
+		limbs[k] &= LIMB_MASK;
+	}
+}
+
+// Sum n doubles into the limbs. The fraction is placed at the same bit offset
+// compute_sums gives it, the exponent field (1 for subnormals), and split into
+// 3 limbs.
+static void compute_limbs(const double *data, int64_t *limbs, int n) {
+	union Data64 val;
+	int64_t exp, frac, sign;
+	unsigned __int128 wide;
+
+	for (int i = 0; i < n; i++){
+		val.f = data[i];
+
+		sign = val.i >> 63;
+		exp = (val.u & EXP) >> 52;
+		frac = val.u & FRAC;
+
+		if (exp) {
+			frac = frac | ONE;
+		}
+		exp += !exp;
+
+		wide = (unsigned __int128) frac << (exp & (LIMB_BITS - 1));
+		int64_t *limb = limbs + (exp >> 5);
+
+		// Negate with the sign mask rather than a branch.
+		limb[0] += (((int64_t) wide & LIMB_MASK) ^ sign) - sign;
+		limb[1] += (((int64_t) (wide >> 32) & LIMB_MASK) ^ sign) - sign;
+		limb[2] += ((int64_t) (wide >> 64) ^ sign) - sign;
+	}
+}
+
+void limbs_init(struct LimbAcc *acc) {
+	for (int k = 0; k < NUM_LIMBS; k++){
+		acc->limbs[k] = 0;
+	}
+	acc->n = 0;
+	acc->pending = 0;
+}
+
+void limbs_add_chunk(struct LimbAcc *acc, const double *data, int n) {
+	int len;
+
+	acc->n += n;
+	while (n > 0) {
+		if (acc->pending >= LIMB_NORM) {
+			normalize_limbs(acc->limbs);
+			acc->pending = 0;
+		}
+		len = LIMB_NORM - acc->pending < n ? (int) (LIMB_NORM - acc->pending) : n;
+
+		compute_limbs(data, acc->limbs, len);
+		acc->pending += len;
+		data += len;
+		n -= len;
+	}
+}
+
+// Turn normalized limbs into the sign-magnitude digits round_mean divides.
+void limbs_to_fix(const int64_t *limbs, struct BigFix *fix) {
+	int64_t mag[NUM_LIMBS];
+	int64_t sign = limbs[NUM_LIMBS - 1] < 0 ? -1 : 1;
+
+	for (int k = 0; k < NUM_LIMBS; k++){
+		mag[k] = limbs[k] * sign;
+	}
+	normalize_limbs(mag);
+
+	for (int k = 0; k < NUM_DIGITS; k++){
+		fix->d[k] = k < NUM_LIMBS ? (uint32_t) mag[k] : 0;
+	}
+	fix->d[NUM_LIMBS] = (uint32_t) (mag[NUM_LIMBS - 1] >> LIMB_BITS);
+	fix->neg = sign < 0;
+
+	fix->len = NUM_DIGITS;
+	while (fix->len > 0 && fix->d[fix->len - 1] == 0) {
+		fix->len--;
+	}
+}
+
+// Exact average of everything added so far, rounded to nearest even by the
+// same round_mean as avg_bits.
+double limbs_finalize(const struct LimbAcc *acc) {
+	int64_t limbs[NUM_LIMBS];
+	struct BigFix sum;
+
+	if (acc->n == 0) {
+		return 0.0;
+	}
+
+	for (int k = 0; k < NUM_LIMBS; k++){
+		limbs[k] = acc->limbs[k];
+	}
+	normalize_limbs(limbs);
+	limbs_to_fix(limbs, &sum);
+
+	return round_mean(&sum, acc->n, ROUND_NEAREST);
+}
+
+double avg_limbs(const double *data, int n){
+	struct LimbAcc acc;
+
+	limbs_init(&acc);
+	limbs_add_chunk(&acc, data, n);
+
+	return limbs_finalize(&acc);
+}
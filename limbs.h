@@ -0,0 +1,31 @@
+#ifndef DOUBLES_LIMBS_H
+#define DOUBLES_LIMBS_H
+
+#include <stdint.h>
+
+#include "bits.h"
+
+// Wide limb alternative to the nibble cells. Every limb holds a 32 bit digit
+// of the exact sum in an int64_t, indexed directly by exponent, so a double
+// touches 3 limbs instead of 14 cells. The 31 spare bits of each limb absorb
+// LIMB_NORM adds before carries have to be pushed up.
+#define LIMB_BITS 32
+#define LIMB_MASK 0xFFFFFFFFll
+#define NUM_LIMBS (NUM_SIZES / 8)
+#define LIMB_NORM (1 << 30)
+
+struct LimbAcc {
+	int64_t limbs[NUM_LIMBS];
+	int64_t n;
+	int64_t pending;
+};
+
+void limbs_init(struct LimbAcc *acc);
+void limbs_add_chunk(struct LimbAcc *acc, const double *data, int n);
+double limbs_finalize(const struct LimbAcc *acc);
+
+void normalize_limbs(int64_t *limbs);
+void limbs_to_fix(const int64_t *limbs, struct BigFix *fix);
+double avg_limbs(const double *data, int n);
+
+#endif //DOUBLES_LIMBS_H
@@ -7,49 +7,45 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
-#include <windows.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "bench.h"
+#include "bits.h"
+#include "engines.h"
+#include "group.h"
+#include "moments.h"
+#include "narrow.h"
+#include "parse.h"
+#include "state.h"
+#include "trace.h"
+#include "window.h"
 
 #define MAXLINE 256
 
+// Number of values read at a time when streaming a trace into an accumulator.
+#define CHUNK 4096
+
 #define lf "%lf"
 #define lg52 "%10.30lg"
 #define lf52 "%58.52lf"
 
 // Trace pretty printing string constants.
-#define COLUMN_NAMES "Filename                           Length            Avg(True)            Avg(Comp)           Error\n"
-#define COLUMN_FMT_STR "%-30s %10d %20.10lg %20.10lg %15.5lg\n"
-
-// Constants for extracting floating point fields from a double
-#define SIGN (1ll << 63)
-#define EXP (0x7FFll << 52)
-#define FRAC ~(0xFFFll << 52)
-
-// Implied leading 1 for adding to normalized fractions.
-#define ONE (1ll << 52)
-
-// The shift and index constants for breaking up a faction field into sums
-#define SHIFT 0x3ll
-#define IND 0x7FCll
-
-// The sums array will contain an integer value representing accumulated
-// fractional fields. The index represents the exponent value. There are 16 + 1
-// buffer cells to hold overflow values. The avgs array will contain the sums
-// array elements divided by n.
-#define NUM_SIZES (512 + 16)
-
-#define INT52_MAX ((1ll << 52) - 1)
-#define INT52_MIN -(1ll << 52)
+#define COLUMN_NAMES "Filename                           Length            Avg(True)            Avg(Comp)           Error"
+#define COLUMN_FMT_STR "%-30s %10lld %20.10lg %20.10lg %15.5lg"
+#define STATS_NAMES "         Adds    VecAdds    Carries Depth     Sweeps   DivSteps  Lo  Hi   Sums(us)    Avg(us)"
+#define STATS_FMT_STR " %12lld %10lld %10lld %5d %10lld %10lld %3d %3d %10.2lf %10.2lf"
+#define MOMENTS_NAMES "Filename                           Length                 Mean             Variance               StdDev                  Min                  Max\n"
+#define MOMENTS_FMT_STR "%-30s %10lld %20.10lg %20.10lg %20.10lg %20.10lg %20.10lg\n"
+#define NARROW_NAMES "Filename                       Format          Length            Avg(True)            Avg(Comp)           Error\n"
+#define NARROW_FMT_STR "%-30s %-11s %10d %20.10Lg %20.10Lg %15.5Lg\n"
 
 // Bit Printing Utility Functions.
-union Data64 {
-	uint64_t b:7;
-    uint64_t u;
-    int64_t i;
-    double f;
-    char bytes[8];
-};
-
 char* toBinary(uint64_t n, int len)
 {
     char* binary = (char*)malloc(sizeof(char) * len + 2);
@@ -65,284 +61,403 @@ char* toBinary(uint64_t n, int len)
 }
 
 void print64(union Data64* data) {
-    printf("int: %lld\nuint: %llu\nfloat: %lg\nbits: %s\n\n", data->i, data->u, data->f, toBinary(data->u, 64));
+    printf("int: %lld\nuint: %llu\nfloat: %lg\nbits: %s\n\n", (long long) data->i, (unsigned long long) data->u, data->f,
+           toBinary(data->u, 64));
 }
 
 // Timing Code.
-#ifdef _WIN32
-    struct timezone {
-        int tz_minuteswest;
-        int tz_dsttime;
-    };
-
-int gettimeofday(struct timeval * tp, struct timezone * tzp)
-    {
-        // Note: some broken versions only have 8 trailing zero's, the correct epoch has 9 trailing zero's
-        // This magic number is the number of 100 nanosecond intervals since January 1, 1601 (UTC)
-        // until 00:00:00 January 1, 1970
-        static const uint64_t EPOCH = ((uint64_t) 116444736000000000ULL);
-
-        SYSTEMTIME  system_time;
-        FILETIME    file_time;
-        uint64_t    time;
-
-        GetSystemTime( &system_time );
-        SystemTimeToFileTime( &system_time, &file_time );
-        time =  ((uint64_t)file_time.dwLowDateTime )      ;
-        time += ((uint64_t)file_time.dwHighDateTime) << 32;
-
-        tp->tv_sec  = (long) ((time - EPOCH) / 10000000L);
-        tp->tv_usec = (long) (system_time.wMilliseconds * 1000);
-        return 0;
-    }
-#endif
-
 double time_diff(struct timeval *start, struct timeval *end)
 {
     return (end->tv_sec - start->tv_sec) + 1e-6*(end->tv_usec - start->tv_usec);
 }
 
-typedef double (*avg_func)(const double*, int);
-typedef int (*cmp_func)(const void * ap, const void * bp);
-
-// Comparison functions.
-int cmp (const void *ap, const void *bp) {
-    double a = *(double *)ap;
-    double b = *(double *)bp;
-    if (b == a) {
-        return 0;
+// Prints the exact mean, variance, standard deviation and range of every trace
+// in dir, each from a single pass.
+int moments_traces(const char *dir) {
+    struct MomentsAcc *acc = malloc(sizeof(struct MomentsAcc));
+    struct Trace trace;
+    char **names;
+    char sPath[2048];
+    double chunk[CHUNK];
+    int len, err, num_traces;
+
+    if ((num_traces = trace_list(dir, &names)) < 0) {
+        printf("Directory path not found: %s\n", dir);
+        return 1;
     }
-    return (a > b ? 1 : -1);
-}
 
-int cmp_inv (const void *ap, const void *bp) {
-    return cmp(ap, bp) * -1;
-}
+    printf(MOMENTS_NAMES);
+    for (int f = 0; f < num_traces; f++){
+        snprintf(sPath, sizeof(sPath), "%s/%s", dir, names[f]);
+        if ((err = trace_open(&trace, sPath)) != 0) {
+            fprintf(stderr, "cannot open file '%s': %s\n", names[f], strerror(err));
+            return 1;
+        }
 
-int cmp_abs (const void *ap, const void *bp) {
-    double a = *(double *)ap;
-    double b = *(double *)bp;
-    if (b == a) {
-        return 0;
+        moments_init(acc);
+        while ((len = trace_read(&trace, chunk, CHUNK)) > 0) {
+            moments_add_chunk(acc, chunk, len);
+        }
+        if (trace.err) {
+            fprintf(stderr, "cannot read file '%s': %s\n", names[f], strerror(trace.err));
+            return 1;
+        }
+        printf(MOMENTS_FMT_STR, names[f], (long long) acc->sum.n, moments_mean(acc),
+               moments_variance(acc, false, ROUND_NEAREST), moments_stddev(acc, false), acc->min, acc->max);
+
+        trace_close(&trace);
+        free(names[f]);
     }
-    return (a*a > b*b ? 1 : -1);
+    free(names);
+    free(acc);
+    return 0;
 }
 
+// Rounds every trace in dir into each narrow format and prints the narrow
+// kernel's mean next to the exact mean of the rounded values, which the bits
+// engine sums as doubles. Traces with values beyond a format's range are
+// skipped for it. Returns 1 if any mean differs.
+int narrow_traces(const char *dir) {
+    struct Trace trace;
+    char **names;
+    char sPath[2048];
+    double *data;
+    void *values;
+    long double ref, avg;
+    int n, err, num_traces, failed = 0;
+
+    if ((num_traces = trace_list(dir, &names)) < 0) {
+        printf("Directory path not found: %s\n", dir);
+        return 1;
+    }
 
+    printf(NARROW_NAMES);
+    for (int f = 0; f < num_traces; f++){
+        snprintf(sPath, sizeof(sPath), "%s/%s", dir, names[f]);
+        if ((err = trace_open(&trace, sPath)) != 0) {
+            fprintf(stderr, "cannot open file '%s': %s\n", names[f], strerror(err));
+            return 1;
+        }
+        if (trace.n > INT_MAX) {
+            fprintf(stderr, "cannot read file '%s': %s\n", names[f], strerror(EFBIG));
+            return 1;
+        }
 
-// Simply adds the doubles and then divides the sum by n.
-double avg_naive(const double *data, int n){
-    double sum = 0.0;
-    for (int i = 0; i < n; i++){
-        sum += data[i];
-    }
-    return sum / (double ) n;
-}
+        data = malloc(trace.n * sizeof(double));
+        values = malloc(trace.n * sizeof(long double));
+        n = trace_read(&trace, data, (int) trace.n);
+        trace_close(&trace);
+        if (trace.err) {
+            fprintf(stderr, "cannot read file '%s': %s\n", names[f], strerror(trace.err));
+            return 1;
+        }
 
-// Same as naive solution but now is now overflow proof.
-double avg_overflow(const double *data, int n){
-    double avg = 0.0;
-    double sum = 0.0;
-    double nd = (double) n;
-
-    double val, rem, max, min;
-    for (int i = 0; i < n; i++){
-        val = data[i];
-
-        max = sum > val ? sum : val;
-        min = sum < val ? sum : val;
-
-        if (min + max == (double) INFINITY) {
-            rem = fmod(max, nd);
-            avg += max / nd;
-            if (rem + min == (double) INFINITY) {
-                rem += fmod(min, nd);
-                avg += min / nd;
-                sum = rem;
+        for (int k = 0; k < num_narrow; k++){
+            if (!narrow_convert(narrow_formats[k].format, data, values, n)) {
+                printf("%-30s %-11s %10d %20s\n", names[f], narrow_formats[k].name, n, "out of range");
                 continue;
             }
-            sum = min + rem;
-            continue;
+            ref = narrow_reference(narrow_formats[k].format, values, n);
+            avg = narrow_avg(narrow_formats[k].format, values, n);
+            failed |= avg != ref;
+            printf(NARROW_FMT_STR, names[f], narrow_formats[k].name, n, ref, avg, ref != 0 ? (ref - avg) / ref : avg);
         }
-        sum = min + max;
-    }
-    avg += sum / nd;
 
-    return avg;
+        free(data);
+        free(values);
+        free(names[f]);
+    }
+    free(names);
+    return failed;
 }
 
-
-// Add x to the appropriate index (in either sums or avgs). In the case that
-// this would overflow what would be the fractional field, add to the next class
-// up.
-void recursive_add(int64_t *cells, int64_t ind, int64_t x) {
-    if (ind >= NUM_SIZES) {
-        raise(SIGINT);
+// Writes a binary copy of every text trace in src to dst, swapping the .csv
+// extension for .bin.
+int convert_traces(const char *src, const char *dst) {
+    struct Trace trace;
+    char **names;
+    char sPath[2048];
+    double *data;
+    int n, err, num_traces, failed = 0;
+
+    if ((num_traces = trace_list(src, &names)) < 0) {
+        printf("Directory path not found: %s\n", src);
+        return 1;
     }
-    int64_t a = cells[ind];
 
-    // If adding x to the current index would overflow,
-    // recurse and add to the next size up. Same the remainder for current size.
+    for (int f = 0; f < num_traces && !failed; f++){
+        snprintf(sPath, sizeof(sPath), "%s/%s", src, names[f]);
+        if ((err = trace_open(&trace, sPath)) != 0) {
+            fprintf(stderr, "cannot open file '%s': %s\n", names[f], strerror(err));
+            failed = 1;
+            break;
+        }
+        if (trace.values) {
+            trace_close(&trace);
+            continue;
+        }
+        if (trace.n > INT_MAX) {
+            fprintf(stderr, "cannot read file '%s': %s\n", names[f], strerror(EFBIG));
+            trace_close(&trace);
+            failed = 1;
+            break;
+        }
 
-    // `a + x` would overflow or underflow
-    if (((x > 0) && (a > INT52_MAX - x))
-    ||  ((x < 0) && (a < INT52_MIN - x))) {
-	    recursive_add(cells, ind + 1, cells[ind] / 16);
-	    cells[ind] = cells[ind] % 16;
+        data = malloc(trace.n * sizeof(double));
+        n = trace_read(&trace, data, (int) trace.n);
+        trace_close(&trace);
+        if (trace.err) {
+            fprintf(stderr, "cannot read file '%s': %s\n", names[f], strerror(trace.err));
+            failed = 1;
+        } else {
+            snprintf(sPath, sizeof(sPath), "%s/%.*s.bin", dst, (int) strlen(names[f]) - 4, names[f]);
+            if ((err = trace_write_bin(sPath, data, n, trace.avg)) != 0) {
+                fprintf(stderr, "cannot write file '%s': %s\n", sPath, strerror(err));
+                failed = 1;
+            } else {
+                printf("%-30s %10d -> %s\n", names[f], n, sPath);
+            }
+        }
+        free(data);
     }
 
-	cells[ind] += x;
+    for (int f = 0; f < num_traces; f++){
+        free(names[f]);
+    }
+    free(names);
+    return failed;
 }
 
-// Starting from the most significant cells, shift down cells by one unless
-// doing so would cause and overflow. Returns true if cells were reduced to
-// smallest cell.
-bool shift_cells(int64_t *cells) {
-	bool zero = true;
-	int64_t x, a;
-
-	for (int i = NUM_SIZES - 1; i > 0; i--){
-		if(cells[i] == 0){
-			continue;
-		}
-
-		a = cells[i-1];
-		x = cells[i] << 4;
-
-		if (!((x > 0) && (a > INT52_MAX - x))
-		&&  !((x < 0) && (a < INT52_MIN - x))) {
-			cells[i-1] += cells[i] << 4;
-			cells[i] = 0;
-		}
-
-		// check that all but the zeroth element are non zero on each pass.
-		if (zero && cells[i] != 0){
-			zero = false;
-		}
-	}
-	return zero;
-}
+// Writes the serialized sums of one shard of the trace at path to out. The
+// shard holds the lines whose index is shard modulo shards, so any number of
+// processes can split a trace and --merge recovers the exact mean.
+int state_trace(const char *path, const char *out, int shard, int shards) {
+    struct BitsAcc *acc = malloc(sizeof(struct BitsAcc));
+    struct Trace trace;
+    uint8_t buf[STATE_MAX_SIZE];
+    double chunk[CHUNK];
+    int64_t mult[CHUNK], line = 0;
+    int len, kept, err;
+    size_t size;
+    FILE *file;
+
+    if ((err = trace_open(&trace, path)) != 0) {
+        fprintf(stderr, "cannot open file '%s': %s\n", path, strerror(err));
+        free(acc);
+        return 1;
+    }
+
+    bits_init(acc);
+    while ((len = trace_read_weighted(&trace, chunk, mult, CHUNK)) > 0) {
+        kept = 0;
+        for (int i = 0; i < len; i++, line++){
+            if (line % shards == shard) {
+                chunk[kept] = chunk[i];
+                mult[kept++] = mult[i];
+            }
+        }
+        bits_add_weighted(acc, chunk, mult, kept);
+    }
+    trace_close(&trace);
+    if (trace.err) {
+        fprintf(stderr, "cannot read file '%s': %s\n", path, strerror(trace.err));
+        free(acc);
+        return 1;
+    }
+
+    size = bits_serialize(acc, buf);
+    free(acc);
 
-// Split all numbers across several split sums.
-void compute_sums(const double *data, int64_t *sums, int n) {
-	int64_t exp, shift, ind, frac;
-	bool sign;
-
-	union Data64 val;
-
-	for (int i = 0; i < n; i++){
-		val.f = data[i];
-
-		// Extract fraction, exponent and sign data from the bit vector.
-		sign = (val.u & SIGN) >> 52;
-		exp = (val.u & EXP) >> 52;
-		frac = (val.u & FRAC);
-
-		// Add implied leading one for normalized fractions.
-		if (exp) {
-			frac = frac | ONE;
-		}
-
-		// Shift the fraction by the first 2 bits of the exponent field.
-		// Use remaining 9 bits for the index into sums/avgs.
-		shift = exp & SHIFT;
-		ind = (exp & IND) >> 2;
-		frac <<= shift;
-
-		// the 13 least significant nibbles (half bytes) are where the fraction bytes will be.
-		// Add each nibble's value to the appropriate cell.
-		int64_t nib = 0xF;
-		int64_t x;
-		for (int j = 0; j <= 13; j++){
-			x = ((frac & nib) >> (j * 4));
-			x *= (sign ? -1 : 1);
-
-			recursive_add(sums, ind + j, x);
-
-			nib <<= 4;
-		}
-	}
+    if (!(file = fopen(out, "wb")) || fwrite(buf, 1, size, file) != size) {
+        fprintf(stderr, "cannot write file '%s': %s\n", out, strerror(errno));
+        if (file) {
+            fclose(file);
+        }
+        return 1;
+    }
+    fclose(file);
+    return 0;
 }
 
-// Divide all sums to get avgs, condense all avg into a single average.
-double compute_avg(int64_t *sums, int64_t *avgs, int n){
-    int64_t  remainder;
-	union Data64 val;
+// Prints the exact mean of the last size values after every value of the
+// trace at path.
+int window_trace(const char *path, int size) {
+    struct WindowAcc win;
+    struct Trace trace;
+    double chunk[CHUNK];
+    int len, err;
+
+    if ((err = trace_open(&trace, path)) != 0) {
+        fprintf(stderr, "cannot open file '%s': %s\n", path, strerror(err));
+        return 1;
+    }
+    if ((err = window_init(&win, size)) != 0) {
+        fprintf(stderr, "cannot allocate window: %s\n", strerror(err));
+        trace_close(&trace);
+        return 1;
+    }
 
-	bool sign;
-	double avg_total;
+    while ((len = trace_read(&trace, chunk, CHUNK)) > 0) {
+        for (int i = 0; i < len; i++){
+            window_push(&win, chunk[i]);
+            printf("%.17lg\n", window_mean(&win));
+        }
+    }
+    if (trace.err) {
+        fprintf(stderr, "cannot read file '%s': %s\n", path, strerror(trace.err));
+    }
 
-	int64_t exp, shift, ind;
+    window_free(&win);
+    trace_close(&trace);
+    return trace.err != 0;
+}
 
-    // boolean that indicates all elements in sum are zeros
-    while(true){
-        for (int i = 0; i < NUM_SIZES; i++){
-            recursive_add(avgs, i, sums[i]/n);
-            sums[i] = sums[i] % n;
+// Reads "key,value" lines from path and prints every key's count and exact
+// mean, in order of first appearance. A first line without a number is taken
+// as a header.
+int group_records(const char *path) {
+    struct GroupTable table;
+    struct stat st;
+    const char *text, *p, *q, *end, *nl, *comma;
+    int64_t line = 0;
+    double x;
+    int fd, err = 0;
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "cannot open file '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+    text = st.st_size ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (text == MAP_FAILED) {
+        fprintf(stderr, "cannot map file '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+    madvise((void *) text, st.st_size, MADV_SEQUENTIAL);
+
+    group_init(&table);
+    end = text + st.st_size;
+    for (p = text; p < end && !err; p = nl + 1){
+        line++;
+        if (!(nl = memchr(p, '\n', end - p))) {
+            nl = end;
+        }
+        if (nl == p || (nl == p + 1 && *p == '\r')) {
+            continue;
         }
-        // shift any non-zero sums down into next bucket,
-        //if that would not cause an overflow. Else leave sum for next pass.
-	    bool all_zero = shift_cells(sums);
 
-	    if(all_zero){
-	        recursive_add(avgs, 0, sums[0]/n);
-            remainder = sums[0] % n;
+        // The value may only be followed by blanks, as in a trace.
+        comma = memchr(p, ',', nl - p);
+        q = comma ? parse_double(comma + 1, nl, &x) : NULL;
+        while (q && q < nl && (*q == ' ' || *q == '\t' || *q == '\r')) {
+            q++;
+        }
+        if (!q || q != nl) {
+            if (line == 1) {
+                continue;
+            }
+            fprintf(stderr, "%s:%lld: expected key,value\n", path, (long long) line);
+            err = EINVAL;
             break;
         }
+        err = group_add(&table, p, (uint32_t) (comma - p), x);
     }
-    // Make sure all cells are shifted together as much as possible.
-    shift_cells(avgs);
 
-    // Handle remainder and the denormalized size class separately.
-    sign = remainder & SIGN;
-	val.i = llabs(remainder);
-    avg_total = val.f/n * (sign ? -1 : 1);
+    if (err == ENOMEM) {
+        fprintf(stderr, "out of memory after %d keys\n", table.num);
+    }
+    if (!err) {
+        for (int e = 0; e < table.num; e++){
+            struct GroupEntry *entry = &table.entries[e];
 
-    sign = avgs[0] & SIGN;
-	val.i = llabs(avgs[0]);
-	avg_total += val.f * (sign ? -1 : 1);
+            printf("%.*s,%lld,%.17lg\n", (int) entry->key_len, entry->key,
+                   (long long) entry->acc.n, group_mean(&entry->acc));
+        }
+    }
 
+    group_free(&table);
+    if (text) {
+        munmap((void *) text, st.st_size);
+    }
+    return err != 0;
+}
 
-	// For normalized numbers, the leading one must be created. Shift the number
-	// and adjust the exponent until the 53rd bit is set.
-	for (int i = 1; i < NUM_SIZES; i++){
-		if(avgs[i] == 0){
-			continue;
-		}
-		sign = avgs[i] & SIGN;
-		val.i = llabs(avgs[i]);
+// Prints the exact mean of every run of len values of the trace at path, the
+// last run taking whatever is left.
+int segment_trace(const char *path, int len) {
+    struct Trace trace;
+    int64_t *offsets;
+    double *data, *out;
+    int n, num, err;
+
+    if ((err = trace_open(&trace, path)) != 0) {
+        fprintf(stderr, "cannot open file '%s': %s\n", path, strerror(err));
+        return 1;
+    }
+    if (trace.n > INT_MAX) {
+        fprintf(stderr, "cannot read file '%s': %s\n", path, strerror(EFBIG));
+        trace_close(&trace);
+        return 1;
+    }
+
+    data = malloc(trace.n * sizeof(double));
+    n = trace_read(&trace, data, (int) trace.n);
+    trace_close(&trace);
+    if (trace.err) {
+        fprintf(stderr, "cannot read file '%s': %s\n", path, strerror(trace.err));
+        free(data);
+        return 1;
+    }
 
-		ind = i << 2;
-		shift = 0;
-		while (!(val.i & ONE)){
-			val.i <<= 1;
-			shift++;
-		}
-		// Zero the exponent field
-		val.i &= ~(EXP);
-		exp = (ind - shift) << 52;
-		val.i += exp;
+    num = (n + len - 1) / len;
+    offsets = malloc((num + 1) * sizeof(int64_t));
+    out = malloc(num * sizeof(double));
+    for (int s = 0; s <= num; s++){
+        offsets[s] = (int64_t) s * len < n ? (int64_t) s * len : n;
+    }
 
-		avg_total += val.f * (sign ? -1 : 1);
-	}
+    avg_segments(data, offsets, num, out);
+    for (int s = 0; s < num; s++){
+        printf("%.17lg\n", out[s]);
+    }
 
-    return avg_total;
+    free(out);
+    free(offsets);
+    free(data);
+    return 0;
 }
 
-// By keeping track of multiple sums at different exponent levels, there is less
-// compute error, if not completely eliminated.
-double avg_bits(const double *data, int n){
-	int64_t  sums[NUM_SIZES], avgs[NUM_SIZES];
+// Merges the serialized states in paths and prints their combined count and
+// exact mean.
+int merge_states(char **paths, int num) {
+    struct BitsAcc *acc = malloc(sizeof(struct BitsAcc));
+    uint8_t buf[STATE_MAX_SIZE + 1];
+    size_t size;
+    FILE *file;
+    int err;
+
+    bits_init(acc);
+    for (int f = 0; f < num; f++){
+        if (!(file = fopen(paths[f], "rb"))) {
+            fprintf(stderr, "cannot open file '%s': %s\n", paths[f], strerror(errno));
+            free(acc);
+            return 1;
+        }
+        size = fread(buf, 1, sizeof(buf), file);
+        fclose(file);
 
-	for (int i = 0; i < NUM_SIZES; i++){
-		sums[i] = 0;
-		avgs[i] = 0;
-	}
+        if ((err = bits_merge_serialized(acc, buf, size)) != 0) {
+            fprintf(stderr, "cannot merge file '%s': %s\n", paths[f], strerror(err));
+            free(acc);
+            return 1;
+        }
+    }
+    printf("%lld %.17lg\n", (long long) acc->n, bits_finalize(acc));
+    free(acc);
+    return 0;
+}
 
-	compute_sums(data, sums, n);
 
-	return compute_avg(sums, avgs, n);
-}
 
 void test() {
 	union Data64 a, b, c;
@@ -357,23 +472,151 @@ void test() {
 	print64(&c);
 }
 
-int main(int argc, char *argv[]) {
+// One trace of a harness run and, once done is set, its result. err holds an
+// errno value if the trace could not be opened or read.
+struct TraceJob {
+    const char *dir;
+    const char *name;
+    avg_func avgFunc;
+    cmp_func cmpFunc;
+    bool stream;
+    int err;
+    int64_t n;
+    double avg;
+    double avg_comp;
+#ifdef BITS_STATS
+    struct BitsStats stats;
+#endif
+    bool done;
+};
+
+// Work queue shared by the harness workers. Workers take traces in filename
+// order and flag each job done under lock, the printer waits on done for the
+// next job in line.
+struct TracePool {
+    struct TraceJob *jobs;
+    int num;
+    int next;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+};
 
-    int n, num_files = 0;
-    double sum, val, avg, avg_comp, err, tot_err = 0.0;
+// Load one trace and average it.
+void run_trace(struct TraceJob *job) {
     double * data;
+    double chunk[CHUNK];
+    int64_t mult[CHUNK];
+    struct BitsAcc acc;
+    struct Trace trace;
+    char sPath[2048];
+    int n, len;
+    bool weighted;
+
+    snprintf(sPath, sizeof(sPath), "%s/%s", job->dir, job->name);
+
+    if((job->err = trace_open(&trace, sPath)) != 0){
+        return;
+    }
+
+    job->n = trace.n;
+    job->avg = trace.avg;
+
+    if(trace.n == 0){
+        trace_close(&trace);
+        return;
+    }
+
+    // Only the streaming path can take more values than fit in one array.
+    if (trace.n > INT_MAX && !job->stream) {
+        job->err = EFBIG;
+        trace_close(&trace);
+        return;
+    }
+    n = (int) trace.n;
+
+#ifdef BITS_STATS
+    bits_stats_reset();
+#endif
+    if (trace.values && !job->cmpFunc) {
+        // Binary traces go to the engine straight from the mapping.
+        job->avg_comp = job->avgFunc(trace.values, n);
+    } else if (job->stream) {
+        // Weighted lines are added as value times count, never expanded.
+        bits_init(&acc);
+        while ((len = trace_read_weighted(&trace, chunk, mult, CHUNK)) > 0) {
+            weighted = false;
+            for (int i = 0; i < len; i++){
+                weighted |= mult[i] != 1;
+            }
+            if (weighted) {
+                bits_add_weighted(&acc, chunk, mult, len);
+            } else {
+                bits_add_chunk(&acc, chunk, len);
+            }
+        }
+        job->n = acc.n;
+        job->avg_comp = bits_finalize(&acc);
+        job->err = trace.err;
+    } else {
+        data = malloc(n * sizeof(double));
+        n = job->n = trace_read(&trace, data, n);
+        job->err = trace.err;
+
+        //Sort list if specified. Calculate avg with the callback function and calculate error.
+        if (job->cmpFunc){
+            qsort(data, n, sizeof(double), job->cmpFunc);
+        }
+        job->avg_comp = job->avgFunc(data, n);
+        free(data);
+    }
+#ifdef BITS_STATS
+    job->stats = bits_stats;
+#endif
+
+    // Cleanup.
+    trace_close(&trace);
+}
+
+void *trace_worker(void *arg) {
+    struct TracePool *pool = arg;
+    int f;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->stop || pool->next == pool->num) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        f = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_trace(&pool->jobs[f]);
 
-    FILE *fp;
-    char *filename, *sDir;
-    char sPath[2048], errbuff[256];
+        pthread_mutex_lock(&pool->lock);
+        pool->jobs[f].done = true;
+        pthread_cond_broadcast(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    int num_files = 0, num_traces, num_jobs = 1;
+    double err, tot_err = 0.0;
+    struct TraceJob *job;
+    struct TracePool pool;
+    pthread_t *workers;
 
-    WIN32_FIND_DATA fdFile;
-    HANDLE hFind = NULL;
-    errno_t file_err;
+    char *sDir;
+    char **names;
 
     avg_func avgFunc = avg_bits;
     cmp_func cmpFunc = NULL;
 
+    // Without sorting, avg_bits never needs the whole trace at once.
+    bool stream = avgFunc == avg_bits && !cmpFunc;
+
     struct timeval start, end;
 
     if (argc < 2) {
@@ -381,59 +624,204 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    // doubles --convert <src> <dst> writes binary copies of the text traces.
+    if (strcmp(argv[1], "--convert") == 0) {
+        if (argc < 4) {
+            printf("Usage: %s --convert <src dir> <dst dir>\n", argv[0]);
+            return 0;
+        }
+        return convert_traces(argv[2], argv[3]);
+    }
+
+    // doubles --bench <dir> [reps] [table|csv|json] times the engines alone.
+    if (strcmp(argv[1], "--bench") == 0) {
+        int format = BENCH_TABLE;
+
+        if (argc < 3) {
+            printf("Usage: %s --bench <dir> [reps] [table|csv|json]\n", argv[0]);
+            return 0;
+        }
+        if (argc > 4) {
+            format = strcmp(argv[4], "csv") == 0 ? BENCH_CSV : strcmp(argv[4], "json") == 0 ? BENCH_JSON : BENCH_TABLE;
+        }
+        return bench_dir(argv[2], argc > 3 ? atoi(argv[3]) : 10, format);
+    }
+
+    // doubles --state <trace> <out> [shard] [shards] saves a shard's sums.
+    if (strcmp(argv[1], "--state") == 0) {
+        int shard = argc > 4 ? atoi(argv[4]) : 0, shards = argc > 5 ? atoi(argv[5]) : 1;
+
+        if (argc < 4 || shards < 1 || shard < 0 || shard >= shards) {
+            printf("Usage: %s --state <trace> <out> [shard] [shards]\n", argv[0]);
+            return 0;
+        }
+        return state_trace(argv[2], argv[3], shard, shards);
+    }
+
+    // doubles --merge <state>... prints the exact mean of saved shards.
+    if (strcmp(argv[1], "--merge") == 0) {
+        if (argc < 3) {
+            printf("Usage: %s --merge <state>...\n", argv[0]);
+            return 0;
+        }
+        return merge_states(argv + 2, argc - 2);
+    }
+
+    // doubles --window <trace> <size> prints the moving average.
+    if (strcmp(argv[1], "--window") == 0) {
+        if (argc < 4 || atoi(argv[3]) < 1) {
+            printf("Usage: %s --window <trace> <size>\n", argv[0]);
+            return 0;
+        }
+        return window_trace(argv[2], atoi(argv[3]));
+    }
+
+    // doubles --group <file> prints the exact mean of every key.
+    if (strcmp(argv[1], "--group") == 0) {
+        if (argc < 3) {
+            printf("Usage: %s --group <key,value file>\n", argv[0]);
+            return 0;
+        }
+        return group_records(argv[2]);
+    }
+
+    // doubles --segments <trace> <len> prints the means of fixed length runs.
+    if (strcmp(argv[1], "--segments") == 0) {
+        if (argc < 4 || atoi(argv[3]) < 1) {
+            printf("Usage: %s --segments <trace> <len>\n", argv[0]);
+            return 0;
+        }
+        return segment_trace(argv[2], atoi(argv[3]));
+    }
+
+    // doubles --narrow <dir> checks the float, half, bfloat16 and long double
+    // kernels on rounded copies of the traces.
+    if (strcmp(argv[1], "--narrow") == 0) {
+        if (argc < 3) {
+            printf("Usage: %s --narrow <dir>\n", argv[0]);
+            return 0;
+        }
+        return narrow_traces(argv[2]);
+    }
+
+    // doubles --moments <dir> prints exact variance and friends instead.
+    if (strcmp(argv[1], "--moments") == 0) {
+        if (argc < 3) {
+            printf("Usage: %s --moments <dir>\n", argv[0]);
+            return 0;
+        }
+        return moments_traces(argv[2]);
+    }
+
     sDir = argv[1];
-    sprintf(sPath, "%s\\*.csv", sDir);
-    if((hFind = FindFirstFile(sPath, &fdFile)) == INVALID_HANDLE_VALUE) {
-        printf("Directory path not found: %s\n", sPath);
+
+    // Optionally pick another engine by name, the parallel one also takes a
+    // thread count.
+    if (argc > 2) {
+        const struct Engine *engine = find_engine(argv[2]);
+
+        if (!engine) {
+            printf("Unknown engine: %s\n", argv[2]);
+            return 0;
+        }
+        avgFunc = engine->func;
+        stream = avgFunc == avg_bits && !cmpFunc;
+    }
+    if (argc > 3) {
+        bits_threads = atoi(argv[3]);
+    }
+
+    // Traces averaged at once, 0 for one per online core.
+    if (argc > 4) {
+        num_jobs = atoi(argv[4]);
+        num_jobs = num_jobs > 0 ? num_jobs : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    if ((num_traces = trace_list(sDir, &names)) < 0) {
+        printf("Directory path not found: %s\n", sDir);
         return 0;
     }
 
     // For rest of the files, c
     printf(COLUMN_NAMES);
+#ifdef BITS_STATS
+    printf(STATS_NAMES);
+#endif
+    printf("\n");
 
     gettimeofday(&start, NULL);
 
-    do{
-        sprintf(sPath, "%s\\%s", sDir, fdFile.cFileName);
-        filename = fdFile.cFileName;
+    pool.jobs = calloc(num_traces, sizeof(struct TraceJob));
+    pool.num = num_traces;
+    pool.next = 0;
+    pool.stop = false;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.done, NULL);
+
+    for (int f = 0; f < num_traces; f++){
+        pool.jobs[f].dir = sDir;
+        pool.jobs[f].name = names[f];
+        pool.jobs[f].avgFunc = avgFunc;
+        pool.jobs[f].cmpFunc = cmpFunc;
+        pool.jobs[f].stream = stream;
+    }
 
-        if((file_err = fopen_s(&fp, sPath, "r")) != 0){
-            strerror_s(errbuff,255 + 1, file_err);
-            fprintf(stderr, "cannot open file '%s': %s\n", filename, errbuff);
-            return 0;
+    num_jobs = num_jobs < num_traces ? num_jobs : num_traces;
+    workers = malloc(num_jobs * sizeof(pthread_t));
+    for (int t = 0; t < num_jobs; t++){
+        if (pthread_create(&workers[t], NULL, trace_worker, &pool) != 0) {
+            num_jobs = t;
+            break;
         }
+    }
 
-        fscanf_s(fp, "n: %d\n", &n);
-        fscanf_s(fp, "avg: " lf "\n", &avg);
-        fscanf_s(fp, "\n");
-
-        if(n == 0){
-            return 0;
-        }
+    // The workers that did start share the traces. Without any, they are
+    // averaged here before printing.
+    if (num_jobs == 0) {
+        trace_worker(&pool);
+    }
 
-        data = malloc(n * sizeof(double));
+    // Print the results in filename order as they come in.
+    for (int f = 0; f < num_traces; f++){
+        job = &pool.jobs[f];
 
-        for(int i = 0; i < n; i++){
-            fscanf_s(fp, lf, &val);
-            data[i] = val;
+        pthread_mutex_lock(&pool.lock);
+        while (!job->done) {
+            pthread_cond_wait(&pool.done, &pool.lock);
         }
+        pthread_mutex_unlock(&pool.lock);
 
-        //Sort list if specified. Calculate avg with the callback function and calculate error.
-        if (cmpFunc){
-            qsort(data, n, sizeof(double), cmpFunc);
+        if (job->err != 0 || job->n == 0) {
+            if (job->err != 0) {
+                fprintf(stderr, "cannot read file '%s': %s\n", job->name, strerror(job->err));
+            }
+            pthread_mutex_lock(&pool.lock);
+            pool.stop = true;
+            pthread_mutex_unlock(&pool.lock);
+            break;
         }
-        avg_comp = avgFunc(data, n);
 
-        err = (avg - avg_comp)/avg;
+        err = (job->avg - job->avg_comp)/job->avg;
         tot_err += fabs(err);
         num_files++;
 
-        printf(COLUMN_FMT_STR, filename, n, avg, avg_comp, err);
+        printf(COLUMN_FMT_STR, job->name, (long long) job->n, job->avg, job->avg_comp, err);
+#ifdef BITS_STATS
+        printf(STATS_FMT_STR, (long long) job->stats.adds, (long long) job->stats.vec_adds, (long long) job->stats.carries,
+               job->stats.max_depth, (long long) job->stats.sweeps, (long long) job->stats.div_steps,
+               job->stats.lo, job->stats.hi, job->stats.sums_ns * 1e-3, job->stats.avg_ns * 1e-3);
+#endif
+        printf("\n");
+    }
 
-        // Cleanup.
-        fclose(fp);
-        free(data);
-    }while(FindNextFile(hFind, &fdFile));
+    for (int t = 0; t < num_jobs; t++){
+        pthread_join(workers[t], NULL);
+    }
+    free(workers);
+
+    if (pool.stop) {
+        return 0;
+    }
     gettimeofday(&end, NULL);
 
     printf("\n");
@@ -441,7 +829,13 @@ int main(int argc, char *argv[]) {
     printf("Average error: %.10lg\n", tot_err/num_files );
 
     // Cleanup.
-    FindClose(hFind);
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.done);
+    free(pool.jobs);
+    for (int f = 0; f < num_traces; f++){
+        free(names[f]);
+    }
+    free(names);
 
     return(0);
 }
\ No newline at end of file
@@ -0,0 +1,233 @@
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "moments.h"
+
+// Elements whose squares are split into the buffers at a time.
+#define SQ_BLOCK 256
+
+// Power of two scales for the low and high square arrays. Above 2^256 the
+// square is kept as (x * 2^-512)^2, below 2^-485 as (x * 2^537)^2, the range
+// where x * x and its fma error term are both exact.
+#define SQ_HIGH_EXP (1023 + 256)
+#define SQ_MID_EXP (1023 - 485)
+
+void moments_init(struct MomentsAcc *acc) {
+	bits_init(&acc->sum);
+	memset(acc->sq, 0, sizeof(acc->sq));
+	for (int k = 0; k < NUM_SQ; k++){
+		acc->sq_lo[k] = NUM_SIZES;
+		acc->sq_hi[k] = 0;
+	}
+	acc->min = INFINITY;
+	acc->max = -INFINITY;
+}
+
+void moments_add_chunk(struct MomentsAcc *acc, const double *data, int n) {
+	double buf[NUM_SQ][2 * SQ_BLOCK];
+	int cnt[NUM_SQ], len, k;
+	double x, p;
+	union Data64 val;
+
+	bits_add_chunk(&acc->sum, data, n);
+
+	for (int i = 0; i < n; i += SQ_BLOCK){
+		len = n - i < SQ_BLOCK ? n - i : SQ_BLOCK;
+		memset(cnt, 0, sizeof(cnt));
+
+		for (int j = i; j < i + len; j++){
+			x = data[j];
+			acc->min = x < acc->min ? x : acc->min;
+			acc->max = x > acc->max ? x : acc->max;
+
+			val.f = x;
+			val.u = (val.u & EXP) >> 52;
+			if (val.u >= SQ_HIGH_EXP) {
+				k = SQ_HIGH;
+				x *= 0x1p-512;
+			} else if (val.u >= SQ_MID_EXP) {
+				k = SQ_MID;
+			} else {
+				k = SQ_LOW;
+				x *= 0x1p537;
+			}
+
+			// x^2 == p + e exactly.
+			p = x * x;
+			buf[k][cnt[k]++] = p;
+			buf[k][cnt[k]++] = fma(x, x, -p);
+		}
+
+		for (k = 0; k < NUM_SQ; k++){
+			compute_sums(buf[k], acc->sq[k], cnt[k], &acc->sq_lo[k], &acc->sq_hi[k]);
+		}
+	}
+}
+
+double moments_mean(const struct MomentsAcc *acc) {
+	return bits_finalize(&acc->sum);
+}
+
+// Normalize a copy of the cells and pack it, returns false for empty cells.
+static bool cells_fix(const int64_t *src, int lo, int hi, struct BigFix *fix) {
+	int64_t cells[NUM_SIZES];
+
+	if (lo > hi) {
+		return false;
+	}
+	memcpy(cells + lo, src + lo, (hi - lo + 1) * sizeof(int64_t));
+	carry_cells(cells, lo, &hi);
+	normalize_cells(cells, &lo, &hi);
+	cells_to_fix(cells, lo, hi, fix);
+	return true;
+}
+
+// a += b << shift, over MOM_DIGITS digits.
+static void big_add_shifted(uint32_t *a, const uint32_t *b, int len, int shift) {
+	uint64_t carry = 0, cur, prev;
+	int k = shift >> 5, s = shift & 31;
+
+	for (int j = 0; j <= len && k + j < MOM_DIGITS; j++){
+		cur = j < len ? b[j] : 0;
+		prev = j > 0 ? b[j - 1] : 0;
+		carry += (uint64_t) a[k + j] + (uint32_t) (((cur << 32) | prev) >> (32 - s));
+		a[k + j] = (uint32_t) carry;
+		carry >>= 32;
+	}
+	for (k += len + 1; carry && k < MOM_DIGITS; k++){
+		carry += a[k];
+		a[k] = (uint32_t) carry;
+		carry >>= 32;
+	}
+}
+
+static void big_mul_small(uint32_t *a, uint64_t m) {
+	unsigned __int128 carry = 0;
+
+	for (int k = 0; k < MOM_DIGITS; k++){
+		carry += (unsigned __int128) a[k] * m;
+		a[k] = (uint32_t) carry;
+		carry >>= 32;
+	}
+}
+
+// a -= b, for a >= b.
+static void big_sub(uint32_t *a, const uint32_t *b) {
+	int64_t borrow = 0;
+
+	for (int k = 0; k < MOM_DIGITS; k++){
+		borrow += (int64_t) a[k] - b[k];
+		a[k] = (uint32_t) borrow;
+		borrow >>= 32;
+	}
+}
+
+// a /= d, returns whether there was a remainder.
+static bool big_div_small(uint32_t *a, uint64_t d) {
+	unsigned __int128 r = 0;
+
+	for (int k = MOM_DIGITS - 1; k >= 0; k--){
+		r = (r << 32) | a[k];
+		a[k] = (uint32_t) (r / d);
+		r %= d;
+	}
+	return r != 0;
+}
+
+// a >>= shift, returns whether any set bit was shifted out.
+static bool big_shr(uint32_t *a, int shift) {
+	int k = shift >> 5, s = shift & 31;
+	bool sticky = false;
+
+	for (int j = 0; j < k; j++){
+		sticky |= a[j] != 0;
+	}
+	sticky |= s && (a[k] & ((1u << s) - 1));
+
+	for (int j = 0; j < MOM_DIGITS; j++){
+		uint64_t x = j + k < MOM_DIGITS ? a[j + k] : 0;
+		uint64_t y = j + k + 1 < MOM_DIGITS ? a[j + k + 1] : 0;
+		a[j] = (uint32_t) (((y << 32) | x) >> s);
+	}
+	return sticky;
+}
+
+// Exact variance, in units of 2^-2150 throughout:
+//
+//   n^2 var = n * sum(x^2) - sum(x)^2
+//
+// The squares are gathered from the three arrays at their scales, the result
+// is divided by n and brought to units of 2^-1075 with the remainders kept as
+// a sticky bit, and round_mean does the last division by n or n - 1. Doubling
+// the quotient and the divisor leaves room for the sticky bit without moving
+// any rounding boundary, all of which are whole units of 2^-1075.
+double moments_variance(const struct MomentsAcc *acc, bool sample, int mode) {
+	static const int sq_shift[NUM_SQ] = {1, 1075, 2099};
+	uint32_t num[MOM_DIGITS], sq[MOM_DIGITS];
+	int64_t n = acc->sum.n, m = sample ? n - 1 : n;
+	struct BigFix fix;
+	double var;
+	bool sticky;
+
+	if (m <= 0) {
+		return NAN;
+	}
+
+	memset(num, 0, sizeof(num));
+	for (int k = 0; k < NUM_SQ; k++){
+		if (cells_fix(acc->sq[k], acc->sq_lo[k], acc->sq_hi[k], &fix)) {
+			big_add_shifted(num, fix.d, fix.len, sq_shift[k]);
+		}
+	}
+	big_mul_small(num, n);
+
+	memset(sq, 0, sizeof(sq));
+	if (cells_fix(acc->sum.sums, acc->sum.lo, acc->sum.hi, &fix)) {
+		for (int j = 0; j < fix.len; j++){
+			uint32_t row[NUM_DIGITS + 1];
+			uint64_t carry = 0;
+
+			for (int i = 0; i < fix.len; i++){
+				carry += (uint64_t) fix.d[i] * fix.d[j];
+				row[i] = (uint32_t) carry;
+				carry >>= 32;
+			}
+			row[fix.len] = (uint32_t) carry;
+			big_add_shifted(sq, row, fix.len + 1, 32 * j);
+		}
+	}
+	big_sub(num, sq);
+
+	sticky = big_div_small(num, n);
+	sticky |= big_shr(num, 1075);
+
+	// Far past the largest double, rounds to it or to infinity.
+	for (int k = NUM_DIGITS - 1; k < MOM_DIGITS; k++){
+		if (num[k]) {
+			return mode == ROUND_DOWN || mode == ROUND_ZERO ? DBL_MAX : INFINITY;
+		}
+	}
+
+	memset(&fix, 0, sizeof(fix));
+	for (int k = NUM_DIGITS - 2; k >= 0; k--){
+		fix.d[k + 1] |= num[k] >> 31;
+		fix.d[k] = num[k] << 1;
+	}
+	fix.d[0] |= sticky;
+	fix.neg = false;
+	fix.len = NUM_DIGITS;
+	while (fix.len > 0 && fix.d[fix.len - 1] == 0) {
+		fix.len--;
+	}
+
+	var = round_mean(&fix, 2 * m, mode);
+	if (isinf(var) && (mode == ROUND_DOWN || mode == ROUND_ZERO)) {
+		return DBL_MAX;
+	}
+	return var;
+}
+
+double moments_stddev(const struct MomentsAcc *acc, bool sample) {
+	return sqrt(moments_variance(acc, sample, ROUND_NEAREST));
+}
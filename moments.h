@@ -0,0 +1,44 @@
+#ifndef DOUBLES_MOMENTS_H
+#define DOUBLES_MOMENTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bits.h"
+
+// Square cell arrays, split by magnitude so every square of a finite double is
+// exact in one of them. Each holds x^2 as the error free pair x*x, fma(x, x,
+// -x*x) of a power of two scaled x.
+enum {
+	SQ_LOW,
+	SQ_MID,
+	SQ_HIGH,
+	NUM_SQ
+};
+
+// 32 bit digits for n times the exact sum of squares, in units of 2^-2150.
+#define MOM_DIGITS (2 * NUM_DIGITS + 8)
+
+// Single pass accumulator for the exact mean, variance and range of a series.
+// The plain sum goes through a BitsAcc, the squares through the sq cells, and
+// the counts must stay below 2^62.
+struct MomentsAcc {
+	struct BitsAcc sum;
+	int64_t sq[NUM_SQ][NUM_SIZES];
+	int sq_lo[NUM_SQ], sq_hi[NUM_SQ];
+	double min, max;
+};
+
+void moments_init(struct MomentsAcc *acc);
+void moments_add_chunk(struct MomentsAcc *acc, const double *data, int n);
+double moments_mean(const struct MomentsAcc *acc);
+
+// Exact variance rounded in the given mode, over n (population) or n - 1
+// (sample).
+double moments_variance(const struct MomentsAcc *acc, bool sample, int mode);
+
+// Square root of the exact variance rounded to nearest, so within an ulp of
+// the exact standard deviation.
+double moments_stddev(const struct MomentsAcc *acc, bool sample);
+
+#endif //DOUBLES_MOMENTS_H
@@ -0,0 +1,300 @@
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bits.h"
+#include "narrow.h"
+
+// Splits a value into its sign, exponent field (1 for subnormals, whose scale
+// is the smallest normal exponent) and the significand including the leading
+// one, one per format.
+static inline void unpack_float(const float *p, bool *sign, int64_t *exp, unsigned __int128 *frac) {
+	uint32_t u;
+
+	memcpy(&u, p, sizeof(u));
+	*sign = u >> 31;
+	*exp = (u >> 23) & 0xFF;
+	*frac = (u & 0x7FFFFF) | (*exp ? 1u << 23 : 0);
+	*exp += !*exp;
+}
+
+static inline void unpack_half(const half_t *p, bool *sign, int64_t *exp, unsigned __int128 *frac) {
+	*sign = *p >> 15;
+	*exp = (*p >> 10) & 0x1F;
+	*frac = (*p & 0x3FF) | (*exp ? 1u << 10 : 0);
+	*exp += !*exp;
+}
+
+static inline void unpack_bfloat16(const bfloat16_t *p, bool *sign, int64_t *exp, unsigned __int128 *frac) {
+	*sign = *p >> 15;
+	*exp = (*p >> 7) & 0xFF;
+	*frac = (*p & 0x7F) | (*exp ? 1u << 7 : 0);
+	*exp += !*exp;
+}
+
+#if LDBL_MANT_DIG == 64
+// x87 extended precision keeps its leading one explicitly in a 64 bit
+// significand, followed by 16 bits of sign and exponent.
+static inline void unpack_long_double(const long double *p, bool *sign, int64_t *exp, unsigned __int128 *frac) {
+	uint64_t mant;
+	uint16_t se;
+
+	memcpy(&mant, p, sizeof(mant));
+	memcpy(&se, (const char *) p + 8, sizeof(se));
+	*sign = se >> 15;
+	*exp = se & 0x7FFF;
+	*frac = mant;
+	*exp += !*exp;
+}
+#endif
+
+// Signed cells [lo, hi] of any size into the magnitude of their sum, in 32 bit
+// digits least significant first. Returns the sign.
+static bool cells_to_digits(const int64_t *cells, int lo, int hi, uint32_t *d, int num_digits) {
+	__int128 carry = 0;
+	bool neg;
+
+	for (int k = 0; k < num_digits; k++){
+		for (int i = 8 * k; i < 8 * k + 8; i++){
+			if (i >= lo && i <= hi) {
+				carry += (__int128) cells[i] * ((__int128) 1 << (4 * (i % 8)));
+			}
+		}
+		d[k] = (uint32_t) carry;
+		carry >>= 32;
+	}
+
+	// Negative sums come out in two's complement.
+	neg = carry < 0;
+	if (neg) {
+		carry = 1;
+		for (int k = 0; k < num_digits; k++){
+			carry += (uint32_t) ~d[k];
+			d[k] = (uint32_t) carry;
+			carry >>= 32;
+		}
+	}
+	return neg;
+}
+
+// One kernel per format. name is the suffix of its functions, type what the
+// data is stored as, ret what the mean is returned as, and ldexp_fn the
+// matching ldexp. exp_bits and frac_bits describe the format, frac_bits not
+// counting the leading one, and bias is the exponent bias. The significand
+// shifted by the low two exponent bits spans nibbles nibbles.
+#define NARROW_KERNEL(name, type, ret, ldexp_fn, exp_bits, frac_bits, bias) \
+	enum { \
+		name##_nibbles = (frac_bits + 1 + 3 + 3) / 4, \
+		name##_sizes = (1 << (exp_bits - 2)) + name##_nibbles + 16, \
+		name##_digits = name##_sizes / 8 + 2 \
+	}; \
+	\
+	static void compute_sums_##name(const type *data, int64_t *sums, int n, int *lo, int *hi) { \
+		int64_t exp, ind, top, x; \
+		unsigned __int128 frac; \
+		int low = *lo, high = *hi; \
+		bool sign; \
+		\
+		for (int i = 0; i < n; i++){ \
+			unpack_##name(data + i, &sign, &exp, &frac); \
+			ind = exp >> 2; \
+			frac <<= exp & 3; \
+			low = ind < low ? (int) ind : low; \
+			\
+			for (int j = 0; j < name##_nibbles; j++){ \
+				x = (int64_t) (frac >> (4 * j)) & 0xF; \
+				top = recursive_add_sized(sums, name##_sizes, ind + j, sign ? -x : x); \
+				high = top > high ? (int) top : high; \
+			} \
+		} \
+		*lo = low; \
+		*hi = high; \
+	} \
+	\
+	ret avg_##name(const type *data, int n) { \
+		int64_t *sums = calloc(name##_sizes, sizeof(int64_t)); \
+		uint32_t d[name##_digits]; \
+		int lo = name##_sizes, hi = 0, len = name##_digits, lsb; \
+		unsigned __int128 m; \
+		bool neg; \
+		\
+		if (n == 0) { \
+			free(sums); \
+			return 0; \
+		} \
+		compute_sums_##name(data, sums, n, &lo, &hi); \
+		neg = cells_to_digits(sums, lo, hi, d, name##_digits); \
+		free(sums); \
+		\
+		while (len > 0 && d[len - 1] == 0) { \
+			len--; \
+		} \
+		m = round_quotient(d, len, neg, n, ROUND_NEAREST, frac_bits + 1, &lsb); \
+		return ldexp_fn((ret) m, lsb - (bias) - (frac_bits)) * (neg ? -1 : 1); \
+	}
+
+NARROW_KERNEL(float, float, float, ldexpf, 8, 23, 127)
+NARROW_KERNEL(half, half_t, float, ldexpf, 5, 10, 15)
+NARROW_KERNEL(bfloat16, bfloat16_t, float, ldexpf, 8, 7, 127)
+#if LDBL_MANT_DIG == 64
+NARROW_KERNEL(long_double, long double, long double, ldexpl, 15, 63, 16383)
+#endif
+
+const struct NarrowFormat narrow_formats[] = {
+	{"float", NARROW_FLOAT, sizeof(float)},
+	{"half", NARROW_HALF, sizeof(half_t)},
+	{"bfloat16", NARROW_BFLOAT16, sizeof(bfloat16_t)},
+#if LDBL_MANT_DIG == 64
+	{"long-double", NARROW_LONG_DOUBLE, sizeof(long double)},
+#endif
+};
+const int num_narrow = sizeof(narrow_formats) / sizeof(narrow_formats[0]);
+
+// Round x to nearest even to frac_bits + 1 significant bits, or to a multiple
+// of the smallest subnormal 2^min_exp, and pack it into a 16 bit format.
+// Returns false past the largest finite value.
+static bool pack16(double x, int frac_bits, int bias, uint16_t *out) {
+	int min_exp = 1 - bias - frac_bits, e;
+	uint16_t sign = signbit(x) ? 1u << 15 : 0;
+	double r, quantum;
+
+	x = fabs(x);
+	e = x > 0 ? ilogb(x) : min_exp;
+	quantum = ldexp(1.0, e - frac_bits > min_exp ? e - frac_bits : min_exp);
+	r = nearbyint(x / quantum) * quantum;
+
+	if (r == 0) {
+		*out = sign;
+		return true;
+	}
+	e = ilogb(r);
+	if (e > bias) {
+		return false;
+	}
+	if (e < 1 - bias) {
+		*out = sign | (uint16_t) ldexp(r, -min_exp);
+	} else {
+		*out = sign | (uint16_t) ((e + bias) << frac_bits) | (uint16_t) (ldexp(r, frac_bits - e) - ldexp(1.0, frac_bits));
+	}
+	return true;
+}
+
+static double unpack16(uint16_t u, int exp_bits, int frac_bits, int bias) {
+	int exp = (u >> frac_bits) & ((1 << exp_bits) - 1);
+	int frac = (u & ((1 << frac_bits) - 1)) | (exp ? 1 << frac_bits : 0);
+	double x = ldexp(frac, (exp ? exp : 1) - bias - frac_bits);
+
+	return u >> 15 ? -x : x;
+}
+
+bool narrow_convert(int format, const double *data, void *out, int n) {
+	bool ok = true;
+
+	for (int i = 0; i < n && ok; i++){
+		switch (format) {
+		case NARROW_FLOAT:
+			((float *) out)[i] = (float) data[i];
+			ok = isfinite(((float *) out)[i]);
+			break;
+		case NARROW_HALF:
+			ok = pack16(data[i], 10, 15, (half_t *) out + i);
+			break;
+		case NARROW_BFLOAT16:
+			ok = pack16(data[i], 7, 127, (bfloat16_t *) out + i);
+			break;
+#if LDBL_MANT_DIG == 64
+		case NARROW_LONG_DOUBLE:
+			((long double *) out)[i] = data[i];
+			break;
+#endif
+		}
+	}
+	return ok;
+}
+
+long double narrow_avg(int format, const void *data, int n) {
+	switch (format) {
+	case NARROW_FLOAT:
+		return avg_float(data, n);
+	case NARROW_HALF:
+		return avg_half(data, n);
+	case NARROW_BFLOAT16:
+		return avg_bfloat16(data, n);
+#if LDBL_MANT_DIG == 64
+	case NARROW_LONG_DOUBLE:
+		return avg_long_double(data, n);
+#endif
+	}
+	return NAN;
+}
+
+// fix >>= shift, for a fix with no set bits below the shift.
+static void fix_shr(struct BigFix *fix, int shift) {
+	int k = shift >> 5, b = shift & 31;
+
+	for (int j = 0; j < NUM_DIGITS; j++){
+		uint64_t x = j + k < NUM_DIGITS ? fix->d[j + k] : 0;
+		uint64_t y = j + k + 1 < NUM_DIGITS ? fix->d[j + k + 1] : 0;
+		fix->d[j] = (uint32_t) (((y << 32) | x) >> b);
+	}
+	fix->len = fix->len > k ? fix->len - k : 0;
+	while (fix->len > 0 && fix->d[fix->len - 1] == 0) {
+		fix->len--;
+	}
+}
+
+// Back to doubles, exact for every format here since long double values only
+// come from narrow_convert, then into the units of the format's own kernel,
+// 2^(-bias - frac bits), so round_quotient stops at the same subnormal step.
+long double narrow_reference(int format, const void *data, int n) {
+	static const int frac_bits[] = {23, 10, 7, 0}, bias[] = {127, 15, 127, 0};
+	struct BitsAcc *acc = malloc(sizeof(struct BitsAcc));
+	struct BigFix sum;
+	double chunk[256];
+	unsigned __int128 m;
+	int len, lsb, scale;
+
+	if (!acc) {
+		return NAN;
+	}
+	bits_init(acc);
+	for (int i = 0; i < n; i += len){
+		len = n - i < 256 ? n - i : 256;
+		for (int j = 0; j < len; j++){
+			switch (format) {
+			case NARROW_FLOAT:
+				chunk[j] = ((const float *) data)[i + j];
+				break;
+			case NARROW_HALF:
+				chunk[j] = unpack16(((const half_t *) data)[i + j], 5, 10, 15);
+				break;
+			case NARROW_BFLOAT16:
+				chunk[j] = unpack16(((const bfloat16_t *) data)[i + j], 8, 7, 127);
+				break;
+#if LDBL_MANT_DIG == 64
+			case NARROW_LONG_DOUBLE:
+				chunk[j] = (double) ((const long double *) data)[i + j];
+				break;
+#endif
+			}
+		}
+		bits_add_chunk(acc, chunk, len);
+	}
+	bits_sum_fix(acc, &sum);
+	free(acc);
+
+	if (n == 0) {
+		return 0;
+	}
+	if (format == NARROW_LONG_DOUBLE) {
+		m = round_quotient(sum.d, sum.len, sum.neg, n, ROUND_NEAREST, LDBL_MANT_DIG, &lsb);
+		return ldexpl((long double) m, lsb - 1075) * (sum.neg ? -1 : 1);
+	}
+
+	scale = bias[format] + frac_bits[format];
+	fix_shr(&sum, 1075 - scale);
+	m = round_quotient(sum.d, sum.len, sum.neg, n, ROUND_NEAREST, frac_bits[format] + 1, &lsb);
+	return ldexpl((long double) m, lsb - scale) * (sum.neg ? -1 : 1);
+}
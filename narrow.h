@@ -0,0 +1,58 @@
+#ifndef DOUBLES_NARROW_H
+#define DOUBLES_NARROW_H
+
+#include <float.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Raw IEEE binary16 and bfloat16 values, C has no arithmetic type for either.
+typedef uint16_t half_t;
+typedef uint16_t bfloat16_t;
+
+// Exact means of series stored in other floating point formats, read in their
+// own width. Every format gets its own compute_sums and cell array from the
+// NARROW_KERNEL template in narrow.c. Cell i counts units of
+// 2^(4i - bias - frac bits), and the array covers that format's exponent
+// range. The mean is rounded to nearest even in the format's own precision,
+// and the 16 bit formats return it as the float holding that value.
+float avg_float(const float *data, int n);
+float avg_half(const half_t *data, int n);
+float avg_bfloat16(const bfloat16_t *data, int n);
+// Only where long double is the x87 80 bit format.
+#if LDBL_MANT_DIG == 64
+long double avg_long_double(const long double *data, int n);
+#endif
+
+// The formats above by index, for the harness and bench, which only load
+// doubles. Each entry gives the storage size of one value.
+enum {
+	NARROW_FLOAT,
+	NARROW_HALF,
+	NARROW_BFLOAT16,
+	NARROW_LONG_DOUBLE
+};
+
+struct NarrowFormat {
+	const char *name;
+	int format;
+	size_t size;
+};
+
+extern const struct NarrowFormat narrow_formats[];
+extern const int num_narrow;
+
+// Round n doubles to nearest even into the format, out holding size bytes per
+// value. Returns false if any of them is beyond the format's range.
+bool narrow_convert(int format, const double *data, void *out, int n);
+
+// The format's avg kernel on converted values.
+long double narrow_avg(int format, const void *data, int n);
+
+// The exact mean of converted values, summed as doubles by the bits engine and
+// rounded once to the format, to check narrow_avg against. For long double
+// the rounding stops at 2^-1074, so only means below 2^-1010 can differ from
+// a true x87 rounding.
+long double narrow_reference(int format, const void *data, int n);
+
+#endif //DOUBLES_NARROW_H
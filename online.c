@@ -0,0 +1,149 @@
+#include <string.h>
+
+#include "bits.h"
+#include "online.h"
+
+#define NUM_BINS 2048
+
+// Independent sets of bins taking alternate elements, so runs of elements
+// with the same exponent do not wait on one bin's last two-sum.
+#define ONLINE_LANES 2
+
+// Elements added between flushes. A bin's sum stays below 2^26 times 2^53 of
+// its unit u, so each two-sum error is at most 2^25 u and the error half stays
+// below 2^51 u, exact for up to 2^26 elements.
+#define ONLINE_FLUSH (1 << 26)
+
+// Exponent fields from which 2^26 elements could overflow a bin. Those bins
+// hold their elements scaled by ONLINE_FACTOR, 2^-ONLINE_SCALE with the scale
+// a multiple of 4 so the flush only moves them whole cells up.
+#define ONLINE_HIGH 2016
+#define ONLINE_SCALE 128
+#define ONLINE_FACTOR 0x1p-128
+
+// A bin's running sum and the exact rounding error of its adds.
+struct Bin {
+	double sum;
+	double err;
+};
+
+// Knuth's two-sum, s + t == a + b exactly.
+static inline double two_sum(double a, double b, double *t) {
+	double s = a + b, bb = s - a;
+
+	*t = (a - (s - bb)) + (b - bb);
+	return s;
+}
+
+// Add the double x, scaled by 2^scale, to the cells.
+static void add_scaled(int64_t *sums, double x, int scale, int *lo, int *hi) {
+	union Data64 val;
+	int64_t exp, frac, ind, top;
+
+	if (x == 0) {
+		return;
+	}
+	val.f = x;
+	exp = (val.u & EXP) >> 52;
+	frac = val.u & FRAC;
+	if (exp) {
+		frac = frac | ONE;
+	}
+	exp += !exp + scale;
+	ind = exp >> 2;
+	frac <<= exp & SHIFT;
+
+	if (ind < *lo) {
+		*lo = (int) ind;
+	}
+	top = add_product(sums, ind, (uint64_t) frac, val.i < 0 ? -1 : 1);
+	if (top > *hi) {
+		*hi = (int) top;
+	}
+}
+
+// Empty the bins [first, last] into the cells, leaving them zero.
+static void flush_bins(struct Bin *bins, int first, int last, int64_t *sums, int *lo, int *hi) {
+	int scale;
+
+	for (int e = first; e <= last; e++){
+		scale = e >= ONLINE_HIGH ? ONLINE_SCALE : 0;
+		add_scaled(sums, bins[e].sum, scale, lo, hi);
+		add_scaled(sums, bins[e].err, scale, lo, hi);
+	}
+	if (first <= last) {
+		memset(bins + first, 0, (last - first + 1) * sizeof(struct Bin));
+	}
+}
+
+// Add x to its bin and widen [first, last] to cover that bin.
+static inline void add_bin(struct Bin *bins, double x, int *first, int *last) {
+	union Data64 val;
+	struct Bin *bin;
+	double t;
+	int e;
+
+	val.f = x;
+	e = (int) ((val.u & EXP) >> 52);
+	x *= e >= ONLINE_HIGH ? ONLINE_FACTOR : 1.0;
+	*first = e < *first ? e : *first;
+	*last = e > *last ? e : *last;
+
+	bin = bins + e;
+	bin->sum = two_sum(bin->sum, x, &t);
+	bin->err += t;
+}
+
+static void compute_bins(const double *data, struct Bin (*bins)[NUM_BINS], int n, int *first, int *last) {
+	int i = 0;
+
+	for (; i + ONLINE_LANES <= n; i += ONLINE_LANES){
+		for (int k = 0; k < ONLINE_LANES; k++){
+			add_bin(bins[k], data[i + k], first, last);
+		}
+	}
+	for (; i < n; i++){
+		add_bin(bins[0], data[i], first, last);
+	}
+}
+
+// Scratch bins, one set per thread. They are all zero between calls, so a
+// call only pays for the bins its data touched.
+static _Thread_local struct Bin scratch[ONLINE_LANES][NUM_BINS];
+
+double avg_online(const double *data, int n) {
+	int64_t sums[NUM_SIZES];
+	int lo = NUM_SIZES, hi = 0, len, first, last;
+	double special;
+
+	if (n == 0) {
+		return 0.0;
+	}
+	memset(sums, 0, sizeof(sums));
+
+	for (int i = 0; i < n; i += len){
+		len = n - i < ONLINE_FLUSH ? n - i : ONLINE_FLUSH;
+		first = NUM_BINS;
+		last = -1;
+		compute_bins(data + i, scratch, len, &first, &last);
+
+		// NaNs and infinities all land in the top bin, which then holds their
+		// IEEE sum. Like a plain sum they decide the mean, and the cells never
+		// see them.
+		if (last == NUM_BINS - 1) {
+			special = 0.0;
+			for (int k = 0; k < ONLINE_LANES; k++){
+				special += scratch[k][last].sum;
+				memset(scratch[k] + first, 0, (last - first + 1) * sizeof(struct Bin));
+			}
+			return special;
+		}
+		for (int k = 0; k < ONLINE_LANES; k++){
+			flush_bins(scratch[k], first, last, sums, &lo, &hi);
+		}
+	}
+
+	carry_cells(sums, lo, &hi);
+	normalize_cells(sums, &lo, &hi);
+	return compute_avg(sums, n, lo, hi, ROUND_NEAREST);
+}
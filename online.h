@@ -0,0 +1,12 @@
+#ifndef DOUBLES_ONLINE_H
+#define DOUBLES_ONLINE_H
+
+// Exact mean in the style of Zhu and Hayes' OnlineExactSum. Each element goes
+// through an error free two-sum into a pair of double bins indexed by its
+// exponent field. Every bin only ever sees multiples of its exponent's unit,
+// which keeps both halves exact for ONLINE_FLUSH elements. The bins are then
+// emptied into the nibble cells, which round the mean as avg_bits does. A NaN
+// or infinity in the data makes the mean their IEEE sum.
+double avg_online(const double *data, int n);
+
+#endif //DOUBLES_ONLINE_H
@@ -0,0 +1,227 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bits.h"
+#include "parse.h"
+#include "pow5.h"
+
+// Significant digits that fit in the 64 bit decimal mantissa.
+#define MAX_DIGITS 19
+
+// Powers of ten a double holds exactly, for Clinger's fast path.
+static const double exact_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool is_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+// Eisel-Lemire: the bits of the double nearest to w * 10^q, for w != 0. The
+// 128 bit truncated power of five gives the product's top bits; returns false
+// in the rare case where that is not enough to decide the rounding.
+static bool eisel_lemire(uint64_t w, int64_t q, uint64_t *bits) {
+	unsigned __int128 product;
+	uint64_t hi, lo, extra, m;
+	int64_t power2;
+	int lz, upper;
+
+	if (q < POW5_MIN) {
+		*bits = 0;
+		return true;
+	}
+	if (q > POW5_MAX) {
+		*bits = EXP;
+		return true;
+	}
+
+	lz = __builtin_clzll(w);
+	w <<= lz;
+
+	product = (unsigned __int128) w * pow5_128[q - POW5_MIN][0];
+	hi = (uint64_t) (product >> 64);
+	lo = (uint64_t) product;
+
+	// The low bits the mantissa is rounded on are all ones, fold in the next
+	// 64 bits of the power.
+	if ((hi & 0x1FF) == 0x1FF) {
+		extra = (uint64_t) (((unsigned __int128) w * pow5_128[q - POW5_MIN][1]) >> 64);
+		lo += extra;
+		hi += extra > lo;
+	}
+	if (lo == UINT64_MAX && (q < -27 || q > 55)) {
+		return false;
+	}
+
+	upper = (int) (hi >> 63);
+	m = hi >> (upper + 9);
+	power2 = ((((152170 + 65536) * q) >> 16) + 63) + upper - lz + 1023;
+
+	// Subnormal result.
+	if (power2 <= 0) {
+		if (-power2 + 1 >= 64) {
+			*bits = 0;
+			return true;
+		}
+		m >>= -power2 + 1;
+		m += m & 1;
+		m >>= 1;
+		*bits = m;
+		return true;
+	}
+
+	// Exactly halfway between two doubles, round to even.
+	if (lo <= 1 && q >= -4 && q <= 23 && (m & 3) == 1 && (m << (upper + 9)) == hi) {
+		m &= ~1ull;
+	}
+
+	m += m & 1;
+	m >>= 1;
+	if (m >= (2ull << 52)) {
+		m = 1ull << 52;
+		power2++;
+	}
+	m &= ~(1ull << 52);
+
+	if (power2 >= 0x7FF) {
+		*bits = EXP;
+		return true;
+	}
+	*bits = m | (uint64_t) power2 << 52;
+	return true;
+}
+
+// Slow but always right, strtod on a terminated copy of the number.
+static double fallback(const char *start, const char *end) {
+	char buf[512], *copy = buf;
+	size_t len = end - start;
+	double val;
+
+	if (len >= sizeof(buf)) {
+		copy = malloc(len + 1);
+	}
+	memcpy(copy, start, len);
+	copy[len] = '\0';
+	val = strtod(copy, NULL);
+
+	if (copy != buf) {
+		free(copy);
+	}
+	return val;
+}
+
+const char *parse_double(const char *p, const char *end, double *out) {
+	const char *start;
+	uint64_t w = 0, bits, bits_up;
+	int64_t q = 0, e = 0;
+	int digits = 0, esign = 1;
+	bool neg = false, any = false, truncated = false;
+	union {
+		uint64_t u;
+		double f;
+	} val;
+
+	while (p < end && is_space(*p)) {
+		p++;
+	}
+	start = p;
+
+	if (p < end && (*p == '-' || *p == '+')) {
+		neg = *p == '-';
+		p++;
+	}
+
+	// Keep the first 19 significant digits in w, value = w * 10^q.
+	for (; p < end && is_digit(*p); p++){
+		any = true;
+		if (digits < MAX_DIGITS) {
+			w = w * 10 + (*p - '0');
+			digits += w != 0;
+		} else {
+			truncated |= *p != '0';
+			q++;
+		}
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && is_digit(*p); p++){
+			any = true;
+			if (digits < MAX_DIGITS) {
+				w = w * 10 + (*p - '0');
+				digits += w != 0;
+				q--;
+			} else {
+				truncated |= *p != '0';
+			}
+		}
+	}
+	if (!any) {
+		return NULL;
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char *mark = p++;
+
+		if (p < end && (*p == '-' || *p == '+')) {
+			esign = *p == '-' ? -1 : 1;
+			p++;
+		}
+		if (p < end && is_digit(*p)) {
+			for (; p < end && is_digit(*p); p++){
+				if (e < 100000) {
+					e = e * 10 + (*p - '0');
+				}
+			}
+			q += esign * e;
+		} else {
+			p = mark;
+		}
+	}
+
+	if (w == 0) {
+		*out = neg ? -0.0 : 0.0;
+		return p;
+	}
+
+	if (!truncated && w <= (1ull << 53) && q >= -22 && q <= 22) {
+		*out = q < 0 ? (double) w / exact_pow10[-q] : (double) w * exact_pow10[q];
+		*out = neg ? -*out : *out;
+		return p;
+	}
+
+	// With digits cut off the true value lies between w and w + 1, if both
+	// round to the same double so does the number.
+	if (eisel_lemire(w, q, &bits)
+	&&  (!truncated || (eisel_lemire(w + 1, q, &bits_up) && bits_up == bits))) {
+		val.u = bits | (neg ? SIGN : 0);
+		*out = val.f;
+		return p;
+	}
+
+	*out = fallback(start, p);
+	return p;
+}
+
+const char *parse_int(const char *p, const char *end, int64_t *out) {
+	int64_t x = 0;
+
+	while (p < end && is_space(*p)) {
+		p++;
+	}
+	if (p == end || !is_digit(*p)) {
+		return NULL;
+	}
+	for (; p < end && is_digit(*p); p++){
+		if (x > (INT64_MAX - (*p - '0')) / 10) {
+			return NULL;
+		}
+		x = x * 10 + (*p - '0');
+	}
+	*out = x;
+	return p;
+}
@@ -0,0 +1,15 @@
+#ifndef DOUBLES_PARSE_H
+#define DOUBLES_PARSE_H
+
+#include <stdint.h>
+
+// Parse one decimal number from [p, end), skipping leading whitespace, into a
+// correctly rounded double. Returns the position just past the number, or NULL
+// when there is no number before end.
+const char *parse_double(const char *p, const char *end, double *out);
+
+// Parse a non negative decimal integer the same way, returns NULL when it
+// does not fit in an int64_t.
+const char *parse_int(const char *p, const char *end, int64_t *out);
+
+#endif //DOUBLES_PARSE_H
@@ -0,0 +1,188 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bits.h"
+#include "decimal.h"
+#include "trace.h"
+
+#define CHUNK 4096
+
+// Write the header of the text trace at path as "n:" and "avg:" lines and a
+// blank line, in the line endings of its first line, keeping everything from
+// body on as it is. A trace without a header gets one.
+static int update_text(const struct Trace *trace, const char *body, const char *path, int64_t n, const char *avg) {
+	const char *eol = trace->text, *nl = "\n";
+	size_t len = strlen(path) + 5;
+	char *tmp = malloc(len);
+	FILE *fp;
+	int err = 0;
+
+	if (!tmp) {
+		return ENOMEM;
+	}
+	snprintf(tmp, len, "%s.tmp", path);
+
+	while (eol < trace->end && *eol != '\r' && *eol != '\n') {
+		eol++;
+	}
+	if (eol < trace->end && *eol == '\r') {
+		nl = eol + 1 < trace->end && eol[1] == '\n' ? "\r\n" : "\r";
+	}
+	while (body < trace->end && (*body == ' ' || *body == '\t' || *body == '\r' || *body == '\n')) {
+		body++;
+	}
+
+	if (!(fp = fopen(tmp, "wb"))) {
+		err = errno;
+		free(tmp);
+		return err;
+	}
+	errno = 0;
+	if (fprintf(fp, "n: %lld%savg: %s%s%s", (long long) n, nl, avg, nl, nl) < 0
+	||  fwrite(body, 1, trace->end - body, fp) != (size_t) (trace->end - body)) {
+		err = errno ? errno : EIO;
+	}
+	if (fclose(fp) != 0 && !err) {
+		err = errno;
+	}
+	if (!err && rename(tmp, path) != 0) {
+		err = errno;
+	}
+	if (err) {
+		remove(tmp);
+	}
+	free(tmp);
+	return err;
+}
+
+// A binary trace only holds the rounded mean, so just that header field is
+// rewritten.
+static int update_bin(const char *path, double avg) {
+	struct TraceHeader header;
+	FILE *fp;
+	int err = 0;
+
+	if (!(fp = fopen(path, "r+b"))) {
+		return errno;
+	}
+	errno = 0;
+	if (fread(&header, sizeof(header), 1, fp) != 1) {
+		err = errno ? errno : EIO;
+	} else {
+		header.avg = avg;
+		if (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, fp) != 1) {
+			err = errno ? errno : EIO;
+		}
+	}
+	if (fclose(fp) != 0 && !err) {
+		err = errno;
+	}
+	return err;
+}
+
+// Print or, with update, write back the exact mean of the trace at path.
+static int ref_trace(const char *path, int places, bool rational, bool update, bool title) {
+	struct BitsAcc *acc = malloc(sizeof(struct BitsAcc));
+	struct BigFix sum;
+	struct Trace trace;
+	double chunk[CHUNK];
+	int64_t mult[CHUNK];
+	const char *body;
+	char *avg = NULL;
+	int len, err;
+
+	if (!acc) {
+		fprintf(stderr, "cannot read file '%s': %s\n", path, strerror(ENOMEM));
+		return 1;
+	}
+	if ((err = trace_open_headerless(&trace, path)) != 0) {
+		fprintf(stderr, "cannot open file '%s': %s\n", path, strerror(err));
+		free(acc);
+		return 1;
+	}
+
+	body = trace.pos;
+	bits_init(acc);
+	while ((len = trace_read_weighted(&trace, chunk, mult, CHUNK)) > 0) {
+		bits_add_weighted(acc, chunk, mult, len);
+	}
+	if (trace.err) {
+		fprintf(stderr, "cannot read file '%s': %s\n", path, strerror(trace.err));
+		err = -1;
+		goto out;
+	}
+	if (acc->n <= 0) {
+		fprintf(stderr, "no values in file '%s'\n", path);
+		err = -1;
+		goto out;
+	}
+
+	bits_sum_fix(acc, &sum);
+	avg = rational ? fix_rational(&sum, acc->n) : fix_decimal(&sum, acc->n, places);
+	if (!avg) {
+		err = ENOMEM;
+	} else if (!update) {
+		if (title) {
+			printf("==> %s <==\n", path);
+		}
+		printf("n: %lld\navg: %s\n\n", (long long) acc->n, avg);
+	} else if (trace.values) {
+		err = update_bin(path, bits_finalize(acc));
+	} else {
+		err = update_text(&trace, body, path, acc->n, avg);
+	}
+	if (err > 0) {
+		fprintf(stderr, "cannot write file '%s': %s\n", path, strerror(err));
+	}
+
+out:
+	trace_close(&trace);
+	free(avg);
+	free(acc);
+	return err != 0;
+}
+
+static void usage(const char *prog) {
+	printf("Usage: %s [-d digits] [-r] [-u] <trace>...\n", prog);
+}
+
+// refmean prints the exact mean of each trace the way testing.py's
+// compute_trace() does, "n:" then "avg:" with 60 digits after the point
+// rounded half to even, built on the exact cells instead of 2000 digit
+// decimals. Traces may lack the header, as generate_trace() writes them. -d
+// sets the digits, -r prints the mean as a reduced fraction and -u writes the
+// header into the trace instead.
+int main(int argc, char *argv[]) {
+	int places = AVG_PLACES, opt, failed = 0;
+	bool rational = false, update = false;
+
+	while ((opt = getopt(argc, argv, "d:ru")) != -1) {
+		switch (opt) {
+		case 'd':
+			places = atoi(optarg);
+			break;
+		case 'r':
+			rational = true;
+			break;
+		case 'u':
+			update = true;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind >= argc || places < 0 || (rational && update)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (int f = optind; f < argc; f++){
+		failed |= ref_trace(argv[f], places, rational, update, argc - optind > 1);
+	}
+	return failed;
+}
@@ -0,0 +1,124 @@
+#include <errno.h>
+#include <string.h>
+
+#include "state.h"
+
+static uint8_t *put_le(uint8_t *p, uint64_t x, int bytes) {
+	for (int i = 0; i < bytes; i++){
+		*p++ = (uint8_t) (x >> (8 * i));
+	}
+	return p;
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes) {
+	uint64_t x = 0;
+
+	for (int i = 0; i < bytes; i++){
+		x |= (uint64_t) p[i] << (8 * i);
+	}
+	return x;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint64_t x) {
+	while (x >= 0x80) {
+		*p++ = (uint8_t) (x | 0x80);
+		x >>= 7;
+	}
+	*p++ = (uint8_t) x;
+	return p;
+}
+
+// Returns the position past the varint, or NULL when it runs past end or
+// does not fit in 64 bits.
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint64_t *x) {
+	*x = 0;
+	for (int shift = 0; p < end && shift < 64; shift += 7){
+		*x |= (uint64_t) (*p & 0x7F) << shift;
+		if (!(*p++ & 0x80)) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+size_t bits_serialize(const struct BitsAcc *acc, uint8_t *buf) {
+	int64_t sums[NUM_SIZES];
+	int lo = acc->lo, hi = acc->hi, prev = -1;
+	uint32_t count = 0;
+	uint8_t *p = buf + STATE_HEADER;
+
+	// Only the window is copied, the carry passes clear the cells above it.
+	if (lo <= hi) {
+		memcpy(sums + lo, acc->sums + lo, (hi - lo + 1) * sizeof(int64_t));
+		carry_cells(sums, lo, &hi);
+		normalize_cells(sums, &lo, &hi);
+	}
+
+	for (int i = lo; i <= hi; i++){
+		if (sums[i] != 0) {
+			p = put_varint(p, (uint64_t) (i - prev));
+			p = put_varint(p, ((uint64_t) sums[i] << 1) ^ (uint64_t) (sums[i] >> 63));
+			prev = i;
+			count++;
+		}
+	}
+
+	memcpy(buf, STATE_MAGIC, 8);
+	put_le(buf + 8, STATE_VERSION, 4);
+	put_le(buf + 12, (uint64_t) acc->n, 8);
+	put_le(buf + 20, count, 4);
+	return p - buf;
+}
+
+int bits_deserialize(struct BitsAcc *acc, const uint8_t *buf, size_t size) {
+	const uint8_t *p = buf + STATE_HEADER, *end = buf + size;
+	uint64_t n, count, step, zig;
+	int64_t ind = -1, x;
+
+	if (size < STATE_HEADER || memcmp(buf, STATE_MAGIC, 8) != 0
+	||  get_le(buf + 8, 4) != STATE_VERSION) {
+		return EINVAL;
+	}
+	n = get_le(buf + 12, 8);
+	count = get_le(buf + 20, 4);
+	if (n > INT64_MAX || count > NUM_SIZES) {
+		return EINVAL;
+	}
+
+	bits_init(acc);
+	acc->n = (int64_t) n;
+	for (uint64_t k = 0; k < count; k++){
+		if (!(p = get_varint(p, end, &step)) || !(p = get_varint(p, end, &zig))) {
+			return EINVAL;
+		}
+		if (step == 0 || step >= (uint64_t) (NUM_SIZES - ind)) {
+			return EINVAL;
+		}
+		ind += (int64_t) step;
+		x = (int64_t) (zig >> 1) ^ -(int64_t) (zig & 1);
+		if (x < INT52_MIN || x > INT52_MAX) {
+			return EINVAL;
+		}
+
+		acc->sums[ind] = x;
+		acc->lo = ind < acc->lo ? (int) ind : acc->lo;
+		acc->hi = (int) ind;
+	}
+
+	// A zero sum still needs a window for the finalize and merge sweeps.
+	if (acc->lo > acc->hi) {
+		acc->lo = acc->hi = 0;
+	}
+	return p == end ? 0 : EINVAL;
+}
+
+int bits_merge_serialized(struct BitsAcc *acc, const uint8_t *buf, size_t size) {
+	struct BitsAcc src;
+	int err;
+
+	if ((err = bits_deserialize(&src, buf, size)) != 0) {
+		return err;
+	}
+	bits_merge(acc, &src);
+	return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef DOUBLES_STATE_H
+#define DOUBLES_STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bits.h"
+
+#define STATE_MAGIC "DBLSTATE"
+#define STATE_VERSION 1
+
+// Fixed part of a serialized state: magic, version, count and number of cells.
+#define STATE_HEADER (8 + 4 + 8 + 4)
+
+// Largest serialized state, every cell present at its widest encoding.
+#define STATE_MAX_SIZE (STATE_HEADER + NUM_SIZES * (2 + 10))
+
+// Serialized form of a BitsAcc, so partial sums can be carried between
+// processes and merged without losing exactness. After the header, every non
+// zero cell of the normalized accumulator follows as its distance from the
+// previous one and its zigzagged value, both as little endian base 128
+// varints. All multi byte fields are little endian whatever the host.
+// Normalizing first makes the encoding canonical, the same exact sum and count
+// always give the same bytes.
+
+// Write acc into buf, which must hold STATE_MAX_SIZE bytes. Returns the number
+// of bytes written.
+size_t bits_serialize(const struct BitsAcc *acc, uint8_t *buf);
+
+// Read a state written by bits_serialize into acc. Returns 0, or EINVAL when
+// buf is not a well formed state of this version.
+int bits_deserialize(struct BitsAcc *acc, const uint8_t *buf, size_t size);
+
+// Fold a serialized state into acc, as bits_merge would. Returns 0, or EINVAL
+// leaving acc untouched.
+int bits_merge_serialized(struct BitsAcc *acc, const uint8_t *buf, size_t size);
+
+#endif //DOUBLES_STATE_H
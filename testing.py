@@ -25,6 +25,9 @@ def generate_trace(filename, func, num):
             f.write("{0:.60f}".format(val))
 
 
+# The native refmean tool prints the same header from the exact sums, for
+# traces straight from generate_trace() too, and with -u writes it into the
+# trace, far faster on large traces.
 def compute_trace(filename):
     dec.getcontext().prec = 2000
     with open(filename, "r") as f:
@@ -51,6 +54,39 @@ def compute_trace(filename):
         print()
 
 
+# Writes pow5.h, the 128 bit truncated powers of five (reciprocals for negative
+# exponents) that the Eisel-Lemire fast path in parse.c multiplies by.
+def pow5_table(filename):
+    mask = (1 << 64) - 1
+    rows = []
+    for q in range(-342, 0):
+        power5 = 5 ** -q
+        z = power5.bit_length()
+        if q >= -27:
+            c = 2 ** (z + 127) // power5 + 1
+        else:
+            c = 2 ** (2 * z + 128) // power5 + 1
+            while c >= (1 << 128):
+                c //= 2
+        rows.append(c)
+    for q in range(0, 308 + 1):
+        power5 = 5 ** q
+        while power5 < (1 << 127):
+            power5 *= 2
+        while power5 >= (1 << 128):
+            power5 //= 2
+        rows.append(power5)
+
+    with open(filename, "w") as f:
+        f.write("// Generated by testing.py pow5_table(), do not edit.\n")
+        f.write("#define POW5_MIN -342\n")
+        f.write("#define POW5_MAX 308\n\n")
+        f.write("static const uint64_t pow5_128[][2] = {\n")
+        for c in rows:
+            f.write("    {{0x{:016x}, 0x{:016x}}},\n".format(c >> 64, c & mask))
+        f.write("};\n")
+
+
 def output_trace(filename):
     with open(filename, "r") as f:
         for ln in f:
@@ -0,0 +1,307 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "parse.h"
+#include "trace.h"
+
+static const char *skip_space(const char *p, const char *end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+		p++;
+	}
+	return p;
+}
+
+// Skip whitespace and match a header key such as "n:".
+static const char *expect(const char *p, const char *end, const char *key) {
+	size_t len = strlen(key);
+
+	p = skip_space(p, end);
+	if ((size_t) (end - p) < len || memcmp(p, key, len) != 0) {
+		return NULL;
+	}
+	return p + len;
+}
+
+// Header fields and payload of a mapped binary trace.
+static int open_bin(struct Trace *trace) {
+	struct TraceHeader header;
+
+	memcpy(&header, trace->text, sizeof(header));
+	if (header.version != TRACE_VERSION || header.size < sizeof(header)
+	||  header.n > INT32_MAX || trace->size != header.size + header.n * sizeof(double)) {
+		return EINVAL;
+	}
+
+	// The values are used in place, which only works on a little endian host.
+	if (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__) {
+		return ENOTSUP;
+	}
+
+	trace->values = (const double *) (trace->text + header.size);
+	trace->pos = (const char *) trace->values;
+	trace->n = (int64_t) header.n;
+	trace->repeat = 0;
+	trace->avg = header.avg;
+
+	if (trace_checksum(trace->values, trace->n) != header.checksum) {
+		return EBADMSG;
+	}
+	return 0;
+}
+
+static int open_trace(struct Trace *trace, const char *path, bool headerless) {
+	struct stat st;
+	const char *p;
+	int64_t n;
+	int fd, err;
+	void *map;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		return errno;
+	}
+	if (fstat(fd, &st) < 0) {
+		err = errno;
+		close(fd);
+		return err;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return EINVAL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	err = errno;
+	close(fd);
+	if (map == MAP_FAILED) {
+		return err;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	trace->text = map;
+	trace->size = st.st_size;
+	trace->end = trace->text + trace->size;
+	trace->values = NULL;
+	trace->count = 0;
+	trace->err = 0;
+
+	if (trace->size >= sizeof(struct TraceHeader) && memcmp(trace->text, TRACE_MAGIC, 8) == 0) {
+		if ((err = open_bin(trace)) != 0) {
+			trace_close(trace);
+		}
+		return err;
+	}
+
+	trace->repeat = 0;
+	p = expect(trace->text, trace->end, "n:");
+
+	// Without a header the values start right away, the count and mean are
+	// what the caller is after.
+	if (!p && headerless) {
+		trace->n = -1;
+		trace->avg = NAN;
+		trace->pos = trace->text;
+		return 0;
+	}
+	p = p ? parse_int(p, trace->end, &n) : NULL;
+	p = p ? expect(p, trace->end, "avg:") : NULL;
+	p = p ? parse_double(p, trace->end, &trace->avg) : NULL;
+	if (!p) {
+		trace_close(trace);
+		return EINVAL;
+	}
+	trace->n = n;
+	trace->pos = p;
+	return 0;
+}
+
+int trace_open(struct Trace *trace, const char *path) {
+	return open_trace(trace, path, false);
+}
+
+int trace_open_headerless(struct Trace *trace, const char *path) {
+	return open_trace(trace, path, true);
+}
+
+// One "value" or "value,mult" line of a text trace. Returns NULL at the end
+// of the trace, or with trace->err set when the line is malformed or its count
+// would take the running total past INT64_MAX.
+static const char *parse_entry(struct Trace *trace, double *val, int64_t *mult) {
+	const char *p = skip_space(trace->pos, trace->end), *end = trace->end;
+
+	if (p == end) {
+		return NULL;
+	}
+	*mult = 1;
+	if (!(p = parse_double(p, end, val))) {
+		trace->err = EINVAL;
+		return NULL;
+	}
+	if (p < end && *p == ',') {
+		// The count must be on the same line, parse_int would skip newlines.
+		for (p++; p < end && (*p == ' ' || *p == '\t'); p++);
+		if (p == end || *p < '0' || *p > '9' || !(p = parse_int(p, end, mult))) {
+			trace->err = EINVAL;
+			return NULL;
+		}
+	}
+	if (p < end && !(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+		trace->err = EINVAL;
+		return NULL;
+	}
+	if (*mult > INT64_MAX - trace->count) {
+		trace->err = EOVERFLOW;
+		return NULL;
+	}
+	trace->count += *mult;
+	return p;
+}
+
+int trace_read(struct Trace *trace, double *data, int n) {
+	const char *p;
+	int64_t mult;
+	int i;
+
+	if (trace->values) {
+		i = (int) ((trace->end - trace->pos) / sizeof(double));
+		i = n < i ? n : i;
+		memcpy(data, trace->pos, i * sizeof(double));
+		trace->pos += i * sizeof(double);
+		return i;
+	}
+
+	for (i = 0; i < n; i++){
+		if (trace->repeat > 0) {
+			data[i] = trace->repeat_val;
+			trace->repeat--;
+			continue;
+		}
+		if (!(p = parse_entry(trace, data + i, &mult))) {
+			break;
+		}
+		trace->pos = p;
+
+		// Skipped entries count nothing, the rest of a run comes next.
+		if (mult < 1) {
+			i--;
+			continue;
+		}
+		trace->repeat_val = data[i];
+		trace->repeat = mult - 1;
+	}
+	return i;
+}
+
+int trace_read_weighted(struct Trace *trace, double *data, int64_t *mult, int n) {
+	const char *p;
+	int i;
+
+	if (trace->values) {
+		i = trace_read(trace, data, n);
+		for (int j = 0; j < i; j++){
+			mult[j] = 1;
+		}
+		return i;
+	}
+
+	for (i = 0; i < n; i++){
+		if (!(p = parse_entry(trace, data + i, mult + i))) {
+			break;
+		}
+		trace->pos = p;
+	}
+	return i;
+}
+
+void trace_close(struct Trace *trace) {
+	munmap((void *) trace->text, trace->size);
+	trace->text = trace->pos = trace->end = NULL;
+	trace->values = NULL;
+	trace->size = 0;
+}
+
+// FNV-1a over the 64 bit words of the values.
+uint64_t trace_checksum_next(uint64_t h, const double *values, int64_t n) {
+	uint64_t x;
+
+	for (int64_t i = 0; i < n; i++){
+		memcpy(&x, values + i, sizeof(x));
+		h = (h ^ x) * 0x100000001B3ull;
+	}
+	return h;
+}
+
+uint64_t trace_checksum(const double *values, int64_t n) {
+	return trace_checksum_next(TRACE_CHECKSUM_INIT, values, n);
+}
+
+void trace_header_init(struct TraceHeader *header, int64_t n, double avg, uint64_t checksum) {
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, TRACE_MAGIC, 8);
+	header->version = TRACE_VERSION;
+	header->size = sizeof(*header);
+	header->n = n;
+	header->avg = avg;
+	header->checksum = checksum;
+}
+
+int trace_write_bin(const char *path, const double *values, int n, double avg) {
+	struct TraceHeader header;
+	FILE *fp;
+	int err = 0;
+
+	trace_header_init(&header, n, avg, trace_checksum(values, n));
+
+	if (!(fp = fopen(path, "wb"))) {
+		return errno;
+	}
+	errno = 0;
+	if (fwrite(&header, sizeof(header), 1, fp) != 1
+	||  fwrite(values, sizeof(double), n, fp) != (size_t) n) {
+		err = errno ? errno : EIO;
+	}
+	if (fclose(fp) != 0 && !err) {
+		err = errno;
+	}
+	return err;
+}
+
+static int cmp_name(const void *ap, const void *bp) {
+	return strcmp(*(char **)ap, *(char **)bp);
+}
+
+int trace_list(const char *dir, char ***names) {
+	DIR *dp;
+	struct dirent *ent;
+	size_t len;
+	int count = 0, cap = 16;
+
+	if (!(dp = opendir(dir))) {
+		return -1;
+	}
+
+	*names = malloc(cap * sizeof(char *));
+	while ((ent = readdir(dp))) {
+		len = strlen(ent->d_name);
+		if (len < 4 || (strcmp(ent->d_name + len - 4, ".csv") != 0 && strcmp(ent->d_name + len - 4, ".bin") != 0)) {
+			continue;
+		}
+		if (count == cap) {
+			cap *= 2;
+			*names = realloc(*names, cap * sizeof(char *));
+		}
+		(*names)[count++] = strdup(ent->d_name);
+	}
+	closedir(dp);
+
+	qsort(*names, count, sizeof(char *), cmp_name);
+	return count;
+}
@@ -0,0 +1,86 @@
+#ifndef DOUBLES_TRACE_H
+#define DOUBLES_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRACE_MAGIC "DBLTRACE"
+#define TRACE_VERSION 1
+#define TRACE_CHECKSUM_INIT 0xCBF29CE484222325ull
+
+// Header of a binary trace, followed directly by the n values as little endian
+// doubles. avg is the reference mean already rounded to a double, and checksum
+// covers the raw bytes of the values. The 64 byte size keeps the values 8 byte
+// aligned in the mapping.
+struct TraceHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t size;
+	uint64_t n;
+	double avg;
+	uint64_t checksum;
+	uint8_t reserved[24];
+};
+
+// A trace file mapped read only into memory. The header gives the number of
+// values and their true mean, trace_read then parses the values straight out
+// of the mapping, so no line ever goes through a stdio buffer. For a binary
+// trace values points at the doubles inside the mapping and can be handed to
+// the avg functions as is. Text lines may be "value,mult", meaning the value
+// occurs mult times, and n then counts every occurrence. count totals the
+// occurrences read so far, and err is set once a line fails to read.
+struct Trace {
+	const char *text;
+	const char *pos;
+	const char *end;
+	size_t size;
+	const double *values;
+	int64_t n;
+	double avg;
+	double repeat_val;
+	int64_t repeat;
+	int64_t count;
+	int err;
+};
+
+// Map the text or binary trace at path and read its header. Returns 0, or an
+// errno value when the file cannot be opened or mapped, EINVAL when the header
+// is malformed, or EBADMSG when a binary trace fails its checksum.
+int trace_open(struct Trace *trace, const char *path);
+
+// Like trace_open, but a text trace may also start straight with its values,
+// the way testing.py's generate_trace() writes them. n is -1 and avg NAN for
+// such a trace.
+int trace_open_headerless(struct Trace *trace, const char *path);
+
+// Parse up to n more values into data, returns how many were read. Weighted
+// lines are expanded into mult copies of their value. Reading stops early at a
+// malformed line with trace->err set to EINVAL, or to EOVERFLOW when the
+// counts would total more than INT64_MAX, so callers check it once the reads
+// return 0.
+int trace_read(struct Trace *trace, double *data, int n);
+
+// Parse up to n more lines into data and their counts into mult, returns how
+// many were read. Unweighted lines get a count of 1.
+int trace_read_weighted(struct Trace *trace, double *data, int64_t *mult, int n);
+
+void trace_close(struct Trace *trace);
+
+uint64_t trace_checksum(const double *values, int64_t n);
+
+// Continue a checksum h over n more values, starting from TRACE_CHECKSUM_INIT,
+// for traces written a block at a time.
+uint64_t trace_checksum_next(uint64_t h, const double *values, int64_t n);
+
+void trace_header_init(struct TraceHeader *header, int64_t n, double avg, uint64_t checksum);
+
+// Write values and their reference mean as a binary trace. Returns 0 or an
+// errno value.
+int trace_write_bin(const char *path, const double *values, int n, double avg);
+
+// Collects the names of the .csv and .bin traces in dir, sorted so every run
+// visits them in the same order. Returns the count, or -1 if dir cannot be
+// opened.
+int trace_list(const char *dir, char ***names);
+
+#endif //DOUBLES_TRACE_H
@@ -0,0 +1,117 @@
+#include <string.h>
+
+#include "wide.h"
+
+// Push every cell's overflow past 64 bits into the next cell up. All cells but
+// the top one end up in [0, 2^64), the top one keeps the sign of the sum.
+void normalize_wide(__int128 *cells) {
+	for (int k = 0; k < NUM_WIDE - 1; k++){
+		cells[k + 1] += cells[k] >> WIDE_BITS;
+		cells[k] &= WIDE_MASK;
+	}
+}
+
+// Sum n doubles into the cells.
+static void compute_wide(const double *data, __int128 *cells, int n) {
+	for (int i = 0; i < n; i++){
+		wide_add(cells, data[i]);
+	}
+}
+
+void wide_init(struct WideAcc *acc) {
+	for (int k = 0; k < NUM_WIDE; k++){
+		acc->cells[k] = 0;
+	}
+	acc->n = 0;
+}
+
+void wide_add_chunk(struct WideAcc *acc, const double *data, int n) {
+	acc->n += n;
+	compute_wide(data, acc->cells, n);
+}
+
+// Turn normalized cells into the sign-magnitude digits round_mean divides.
+void wide_to_fix(const __int128 *cells, struct BigFix *fix) {
+	__int128 mag[NUM_WIDE];
+	int sign = cells[NUM_WIDE - 1] < 0 ? -1 : 1;
+
+	for (int k = 0; k < NUM_WIDE; k++){
+		mag[k] = cells[k] * sign;
+	}
+	normalize_wide(mag);
+
+	for (int k = 0; k < NUM_DIGITS; k++){
+		fix->d[k] = k < 2 * NUM_WIDE ? (uint32_t) (mag[k / 2] >> (32 * (k % 2))) : 0;
+	}
+	fix->neg = sign < 0;
+
+	fix->len = NUM_DIGITS;
+	while (fix->len > 0 && fix->d[fix->len - 1] == 0) {
+		fix->len--;
+	}
+}
+
+// Turn the len signed cells starting at cell lo, cells[0] being cell lo and
+// every cell outside zero, into sign-magnitude digits. One signed carry pass
+// gives 64 bit two's complement digits, with one more digit above the range
+// for the carry out of its top, and they are negated in place when the sum is
+// negative. The cells must stay below 2^126 in magnitude.
+void wide_range_to_fix(const __int128 *cells, int lo, int len, struct BigFix *fix) {
+	uint64_t digits[NUM_WIDE];
+	int end = lo + len < NUM_WIDE ? lo + len + 1 : NUM_WIDE, top = lo;
+	__int128 carry = 0;
+
+	for (int k = lo; k < end; k++){
+		carry += k - lo < len ? cells[k - lo] : 0;
+		digits[k] = (uint64_t) carry;
+		carry >>= WIDE_BITS;
+		top = digits[k] ? k + 1 : top;
+	}
+
+	fix->neg = carry < 0;
+	if (fix->neg) {
+		top = lo;
+		carry = 1;
+		for (int k = lo; k < end; k++){
+			carry += ~digits[k];
+			digits[k] = (uint64_t) carry;
+			carry >>= WIDE_BITS;
+			top = digits[k] ? k + 1 : top;
+		}
+	}
+
+	memset(fix->d, 0, 2 * lo * sizeof(uint32_t));
+	for (int k = lo; k < top; k++){
+		fix->d[2 * k] = (uint32_t) digits[k];
+		fix->d[2 * k + 1] = (uint32_t) (digits[k] >> 32);
+	}
+	fix->len = top > lo ? 2 * top - (fix->d[2 * top - 1] == 0) : 0;
+}
+
+// Exact average of everything added so far, rounded to nearest even by the
+// same round_mean as avg_bits.
+double wide_finalize(const struct WideAcc *acc) {
+	__int128 cells[NUM_WIDE];
+	struct BigFix sum;
+
+	if (acc->n == 0) {
+		return 0.0;
+	}
+
+	for (int k = 0; k < NUM_WIDE; k++){
+		cells[k] = acc->cells[k];
+	}
+	normalize_wide(cells);
+	wide_to_fix(cells, &sum);
+
+	return round_mean(&sum, acc->n, ROUND_NEAREST);
+}
+
+double avg_wide(const double *data, int n){
+	struct WideAcc acc;
+
+	wide_init(&acc);
+	wide_add_chunk(&acc, data, n);
+
+	return wide_finalize(&acc);
+}
@@ -0,0 +1,67 @@
+#ifndef DOUBLES_WIDE_H
+#define DOUBLES_WIDE_H
+
+#include <stdint.h>
+
+#include "bits.h"
+
+// 128 bit cell variant of the accumulator. Every cell holds a 64 bit digit of
+// the exact sum in an __int128, so a double touches 2 cells, and with less than
+// 2^64 added per element the 63 spare bits take 2^63 elements, more than any
+// int64_t count, before a cell could overflow. No carry is ever checked or
+// pushed while adding, only once when the mean is read.
+#define WIDE_BITS 64
+#define WIDE_MASK (((unsigned __int128) 1 << WIDE_BITS) - 1)
+#define NUM_WIDE (NUM_SIZES / 16 + 1)
+
+struct WideAcc {
+	__int128 cells[NUM_WIDE];
+	int64_t n;
+};
+
+// Split one double into the signed pieces it adds to two neighbouring cells,
+// at the same bit offset compute_sums gives the fraction, the exponent field
+// (1 for subnormals). Returns the lower cell's index.
+static inline int wide_split(double x, __int128 *lo, __int128 *hi) {
+	union Data64 val;
+	int64_t exp, frac, sign;
+	unsigned __int128 wide;
+
+	val.f = x;
+
+	sign = val.i >> 63;
+	exp = (val.u & EXP) >> 52;
+	frac = val.u & FRAC;
+
+	if (exp) {
+		frac = frac | ONE;
+	}
+	exp += !exp;
+
+	wide = (unsigned __int128) frac << (exp & (WIDE_BITS - 1));
+
+	// Negate with the sign mask rather than a branch.
+	*lo = ((__int128) (wide & WIDE_MASK) ^ sign) - sign;
+	*hi = ((__int128) (wide >> WIDE_BITS) ^ sign) - sign;
+	return (int) (exp >> 6);
+}
+
+// Add one double into the cells. Adding -x takes x back out exactly.
+static inline void wide_add(__int128 *cells, double x) {
+	__int128 lo, hi;
+	int k = wide_split(x, &lo, &hi);
+
+	cells[k] += lo;
+	cells[k + 1] += hi;
+}
+
+void wide_init(struct WideAcc *acc);
+void wide_add_chunk(struct WideAcc *acc, const double *data, int n);
+double wide_finalize(const struct WideAcc *acc);
+
+void normalize_wide(__int128 *cells);
+void wide_to_fix(const __int128 *cells, struct BigFix *fix);
+void wide_range_to_fix(const __int128 *cells, int lo, int len, struct BigFix *fix);
+double avg_wide(const double *data, int n);
+
+#endif //DOUBLES_WIDE_H
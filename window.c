@@ -0,0 +1,72 @@
+#include <errno.h>
+#include <stdlib.h>
+
+#include "window.h"
+
+int window_init(struct WindowAcc *win, int size) {
+	if (!(win->ring = malloc(size * sizeof(double)))) {
+		return ENOMEM;
+	}
+	wide_init(&win->sum);
+	win->lo = NUM_WIDE;
+	win->hi = 0;
+	win->size = size;
+	win->head = 0;
+	win->count = 0;
+	return 0;
+}
+
+void window_free(struct WindowAcc *win) {
+	free(win->ring);
+	win->ring = NULL;
+}
+
+void window_push(struct WindowAcc *win, double x) {
+	union Data64 val;
+	int tail, cell;
+
+	if (win->count == win->size) {
+		window_pop(win);
+	}
+	tail = win->head + win->count;
+	tail -= tail >= win->size ? win->size : 0;
+
+	win->ring[tail] = x;
+	win->count++;
+	wide_add(win->sum.cells, x);
+	win->sum.n++;
+
+	// Zeros add nothing anywhere, so they do not widen the range.
+	val.f = x;
+	if (val.u << 1) {
+		cell = (int) (((val.u & EXP) >> 52) + !(val.u & EXP)) >> 6;
+		win->lo = cell < win->lo ? cell : win->lo;
+		win->hi = cell > win->hi ? cell : win->hi;
+	}
+}
+
+double window_pop(struct WindowAcc *win) {
+	double x = win->ring[win->head];
+
+	win->head = win->head + 1 == win->size ? 0 : win->head + 1;
+	win->count--;
+	wide_add(win->sum.cells, -x);
+	win->sum.n--;
+	return x;
+}
+
+// Only the cells from the lowest a sample started in to the one above the
+// highest are read, a sample reaches the cell above its own.
+double window_mean(const struct WindowAcc *win) {
+	struct BigFix sum;
+	int lo = win->lo, len = win->hi + 2 - win->lo;
+
+	if (win->count == 0) {
+		return 0.0;
+	}
+	if (len <= 0) {
+		lo = len = 0;
+	}
+	wide_range_to_fix(win->sum.cells + lo, lo, len, &sum);
+	return round_mean(&sum, win->count, ROUND_NEAREST);
+}
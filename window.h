@@ -0,0 +1,34 @@
+#ifndef DOUBLES_WINDOW_H
+#define DOUBLES_WINDOW_H
+
+#include "wide.h"
+
+// Exact moving average over the last size samples. The window's sum lives in
+// the 128 bit cells of a WideAcc, where taking a sample back out is adding its
+// negation, so a push or pop touches two cells and never drifts however long
+// the stream runs. Reading the mean normalizes a copy of the NUM_WIDE cells
+// and divides, instead of percolating all NUM_SIZES nibble cells. Only the
+// cells from lo to hi, the range of cells any sample has started in, are read.
+// The samples themselves are kept in a ring so the oldest can be popped.
+struct WindowAcc {
+	struct WideAcc sum;
+	double *ring;
+	int size, head, count;
+	int lo, hi;
+};
+
+// Returns 0, or ENOMEM when the ring cannot be allocated.
+int window_init(struct WindowAcc *win, int size);
+void window_free(struct WindowAcc *win);
+
+// Add x as the newest sample. A full window drops its oldest sample first.
+void window_push(struct WindowAcc *win, double x);
+
+// Remove and return the oldest sample, the window must not be empty.
+double window_pop(struct WindowAcc *win);
+
+// Exact mean of the samples in the window, rounded to nearest even, 0 when it
+// is empty.
+double window_mean(const struct WindowAcc *win);
+
+#endif //DOUBLES_WINDOW_H